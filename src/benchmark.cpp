@@ -18,16 +18,27 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <istream>
+#include <sstream>
+#include <thread>
 #include <vector>
 
 #include "misc.h"
+#include "movegen.h"
 #include "position.h"
 #include "search.h"
 #include "thread.h"
+#include "tt.h"
 #include "uci.h"
+#include "syzygy/tbprobe.h"
+
+#include <mpi.h>
 
 using namespace std;
 
@@ -86,6 +97,188 @@ const vector<string> Defaults = {
   "7k/7P/6K1/8/3B4/8/8/8 b - -"
 };
 
+/// Result records the outcome of the search of one bench position
+
+struct Result {
+  uint64_t nodes, tbHits;
+  TimePoint time;
+  int depth, selDepth, hashfull;
+  Move bestMove;
+};
+
+/// Summary holds mean, standard deviation and the 95% confidence interval
+/// half-width of a sample, using the Student t distribution for small samples.
+
+struct Summary {
+
+  Summary(const vector<double>& v) {
+
+    size_t n = v.size();
+    double sum = 0, sq = 0;
+
+    for (double x : v)
+        sum += x;
+
+    mean = sum / n;
+
+    for (double x : v)
+        sq += (x - mean) * (x - mean);
+
+    // Two-sided 95% t values for 1..10 degrees of freedom, then an approximation
+    const double T95[] = { 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228 };
+
+    stddev = n > 1 ? sqrt(sq / (n - 1)) : 0;
+    ci95 = n > 1 ? (n <= 11 ? T95[n - 2] : 1.96 + 2.5 / (n - 1)) * stddev / sqrt(n) : 0;
+  }
+
+  double mean, stddev, ci95;
+};
+
+
+/// read_fens() fills 'fens' with the default positions, the current one or
+/// the lines of the given file. Returns false if the file cannot be opened.
+
+bool read_fens(const Position& current, const string& fenFile, vector<string>& fens) {
+
+  if (fenFile == "default")
+      fens = Defaults;
+
+  else if (fenFile == "current")
+      fens.push_back(current.fen());
+
+  else
+  {
+      string fen;
+      ifstream file(fenFile);
+
+      if (!file.is_open())
+      {
+          cerr << "Unable to open file " << fenFile << endl;
+          return false;
+      }
+
+      while (getline(file, fen))
+          if (!fen.empty())
+              fens.push_back(fen);
+
+      file.close();
+  }
+
+  return true;
+}
+
+
+/// to_san() converts a legal move to Standard Algebraic Notation without the
+/// check and mate suffixes, as used by the bm and am operations of EPD files.
+
+string to_san(const Position& pos, Move m) {
+
+  if (type_of(m) == CASTLING)
+      return to_sq(m) > from_sq(m) ? "O-O" : "O-O-O";
+
+  Square from = from_sq(m), to = to_sq(m);
+  PieceType pt = type_of(pos.moved_piece(m));
+  string san;
+
+  if (pt == PAWN)
+  {
+      if (pos.capture(m))
+          san = UCI::square(from)[0];
+  }
+  else
+  {
+      bool ambiguous = false, sameFile = false, sameRank = false;
+
+      san = " PNBRQK"[pt];
+
+      // Disambiguate with the file, the rank or both when another piece of
+      // the same type can reach the destination square.
+      for (const auto& other : MoveList<LEGAL>(pos))
+          if (   other != m
+              && to_sq(other) == to
+              && type_of(pos.moved_piece(other)) == pt)
+          {
+              ambiguous = true;
+              sameFile |= file_of(from_sq(other)) == file_of(from);
+              sameRank |= rank_of(from_sq(other)) == rank_of(from);
+          }
+
+      if (ambiguous)
+          san += !sameFile ? UCI::square(from).substr(0, 1)
+               : !sameRank ? UCI::square(from).substr(1, 1) : UCI::square(from);
+  }
+
+  if (pos.capture(m))
+      san += 'x';
+
+  san += UCI::square(to);
+
+  if (type_of(m) == PROMOTION)
+      san += string("=") + " PNBRQK"[promotion_type(m)];
+
+  return san;
+}
+
+
+/// parse_move() finds the legal move given in SAN or in coordinate notation,
+/// returns MOVE_NONE if there is none. Annotations, check and mate marks are
+/// ignored, as are the '=' of promotions and castling written with zeros.
+
+Move parse_move(const Position& pos, string str) {
+
+  auto normalize = [](string s) {
+      string r;
+      for (char c : s)
+          if (!strchr("+#!?=", c))
+              r += c == '0' ? 'O' : c;
+      return r;
+  };
+
+  str = normalize(str);
+
+  for (const auto& m : MoveList<LEGAL>(pos))
+      if (   normalize(to_san(pos, m)) == str
+          || UCI::move(m, pos.is_chess960()) == str)
+          return m;
+
+  return MOVE_NONE;
+}
+
+
+/// run() searches, or runs perft on, a single position with the given limits
+
+Result run(Position& pos, const string& fen, Search::LimitsType& limits, bool perft) {
+
+  StateListPtr states(new std::deque<StateInfo>(1));
+  pos.set(fen, Options["UCI_Chess960"], &states->back(), Threads.main());
+
+  Result res = {};
+  res.time = now();
+
+  if (perft)
+  {
+      res.nodes = Search::perft(pos, limits.depth * ONE_PLY);
+      res.depth = limits.depth;
+  }
+  else
+  {
+      limits.startTime = now();
+      Threads.start_thinking(pos, states, limits);
+      Threads.main()->wait_for_search_finished();
+
+      Thread* best = Threads.main()->bestThread;
+      res.nodes = Threads.nodes_searched();
+      res.tbHits = Threads.tb_hits();
+      res.depth = best->completedDepth / ONE_PLY;
+      res.selDepth = best->maxPly;
+      res.hashfull = TT.hashfull();
+      res.bestMove = best->rootMoves[0].pv[0];
+  }
+
+  res.time = now() - res.time;
+  return res;
+}
+
 } // namespace
 
 /// benchmark() runs a simple benchmark by letting Stockfish analyze a set
@@ -93,8 +286,18 @@ const vector<string> Defaults = {
 /// transposition table size, the number of search threads that should
 /// be used, the limit value spent for each position (optional, default is
 /// depth 13), an optional file name where to look for positions in FEN
-/// format (defaults are the positions defined above) and the type of the
-/// limit value: depth (default), time in millisecs or number of nodes.
+/// format (defaults are the positions defined above), the type of the
+/// limit value: depth (default), time in millisecs or number of nodes, the
+/// output format: text (default), json or csv, the number of runs over the
+/// whole set of positions (default 1) and an optional file for the report.
+/// In json and csv mode the search output is muted and a report with the
+/// per-position results is written to that file, or else to stdout. The csv
+/// report ends with a row per run with 'all' as position and the totals of
+/// the run; the mean, standard deviation and 95% confidence interval of the
+/// nodes/second of the runs are in the json report and, for all formats, in
+/// the summary written to stderr. Under MPI every rank searches each position:
+/// nodes and tbhits are summed over the ranks, times are those of the slowest
+/// rank and only rank 0 writes the report and the summary.
 
 void benchmark(const Position& current, istream& is) {
 
@@ -108,10 +311,14 @@ void benchmark(const Position& current, istream& is) {
   string limit     = (is >> token) ? token : "13";
   string fenFile   = (is >> token) ? token : "default";
   string limitType = (is >> token) ? token : "depth";
+  string format    = (is >> token) ? token : "text";
+  int runs         = (is >> token) ? max(atoi(token.c_str()), 1) : 1;
+  string report    = (is >> token) ? token : "";
 
   Options["Hash"]    = ttSize;
   Options["Threads"] = threads;
   Search::clear();
+  timers_clear();
 
   if (limitType == "time")
       limits.movetime = stoi(limit); // movetime is in millisecs
@@ -125,59 +332,401 @@ void benchmark(const Position& current, istream& is) {
   else
       limits.depth = stoi(limit);
 
-  if (fenFile == "default")
-      fens = Defaults;
+  if (!read_fens(current, fenFile, fens))
+      return;
 
-  else if (fenFile == "current")
-      fens.push_back(current.fen());
+  vector<vector<Result>> results(runs);
+  vector<TimePoint> elapsed(runs);
+  PerfCounts perfStart = Threads.perf_counts();
+  uint64_t totalNodes = 0;
+  Position pos;
 
-  else
+  info_out.silent = (format == "json" || format == "csv");
+
+  for (int r = 0; r < runs; ++r)
   {
-      string fen;
-      ifstream file(fenFile);
+      if (r)
+          Search::clear(); // Every run starts from the same state
+
+      elapsed[r] = now();
+
+      for (size_t i = 0; i < fens.size(); ++i)
+      {
+          cerr << "\nPosition: " << i + 1 << '/' << fens.size() << endl;
+
+          Result res = run(pos, fens[i], limits, limitType == "perft");
+          totalNodes += res.nodes;
+          results[r].push_back(res);
+      }
+
+      elapsed[r] = now() - elapsed[r] + 1; // Ensure positivity to avoid a 'divide by zero'
+  }
+
+  info_out.silent = false;
+
+  dbg_print(); // Just before exiting
+  timers_print();
+
+  if (Options["PerfCounters"])
+      cerr << (mpi_size > 1 ? "Rank " + std::to_string(mpi_rank) + " " : "")
+           << (Threads.perf_counts() - perfStart).report(totalNodes) << endl;
+
+  if (Tablebases::MaxCardinality)
+      cerr << "\n" << Tablebases::stats() << endl;
+
+  // Nodes and tbhits are summed over the ranks, times are the slowest rank
+  vector<uint64_t> counts;
+  vector<int64_t> times(elapsed.begin(), elapsed.end());
+
+  for (const auto& rr : results)
+      for (const Result& res : rr)
+      {
+          counts.push_back(res.nodes);
+          counts.push_back(res.tbHits);
+          times.push_back(res.time);
+      }
+
+  MPI_Allreduce(MPI_IN_PLACE, counts.data(), int(counts.size()), MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+  MPI_Allreduce(MPI_IN_PLACE, times.data(), int(times.size()), MPI_INT64_T, MPI_MAX, MPI_COMM_WORLD);
+
+  if (mpi_rank != 0)
+      return;
+
+  vector<uint64_t> nodes(runs);
+  vector<double> nps, secs;
+
+  for (int r = 0, k = 0; r < runs; ++r)
+  {
+      elapsed[r] = times[r];
+
+      for (Result& res : results[r])
+      {
+          res.nodes  = counts[2 * k];
+          res.tbHits = counts[2 * k + 1];
+          res.time   = times[runs + k++];
+          nodes[r] += res.nodes;
+      }
+
+      nps.push_back(1000.0 * nodes[r] / elapsed[r]);
+      secs.push_back(double(elapsed[r]));
+  }
+
+  Summary s(nps), st(secs);
+  ofstream file;
+
+  if (!report.empty())
+  {
+      file.open(report);
 
       if (!file.is_open())
+          cerr << "Unable to open file " << report << endl;
+  }
+
+  ostream& out = file.is_open() ? file : cout;
+
+  if (format == "json")
+  {
+      out << "{\n  \"limit\": " << limit << ", \"limitType\": \"" << limitType
+          << "\", \"hash\": " << ttSize << ", \"threads\": " << threads
+          << ", \"ranks\": " << mpi_size << ",\n  \"runs\": [";
+
+      for (int r = 0; r < runs; ++r)
       {
-          cerr << "Unable to open file " << fenFile << endl;
-          return;
+          out << (r ? "," : "") << "\n    { \"nodes\": " << nodes[r]
+              << ", \"nps\": " << uint64_t(nps[r])
+              << ", \"time\": " << elapsed[r] << ", \"positions\": [";
+
+          for (size_t i = 0; i < fens.size(); ++i)
+          {
+              const Result& res = results[r][i];
+
+              out << (i ? "," : "") << "\n      { \"fen\": \"" << fens[i]
+                  << "\", \"nodes\": " << res.nodes
+                  << ", \"time\": " << res.time
+                  << ", \"nps\": " << 1000 * res.nodes / (res.time + 1)
+                  << ", \"depth\": " << res.depth
+                  << ", \"seldepth\": " << res.selDepth
+                  << ", \"hashfull\": " << res.hashfull
+                  << ", \"tbhits\": " << res.tbHits
+                  << ", \"bestmove\": \"" << UCI::move(res.bestMove, pos.is_chess960()) << "\" }";
+          }
+
+          out << "\n    ] }";
       }
 
-      while (getline(file, fen))
-          if (!fen.empty())
-              fens.push_back(fen);
+      out << fixed << setprecision(1)
+          << "\n  ],\n  \"nps\": { \"mean\": " << s.mean << ", \"stddev\": " << s.stddev
+          << ", \"ci95\": [" << s.mean - s.ci95 << ", " << s.mean + s.ci95 << "] }"
+          << ",\n  \"time\": { \"mean\": " << st.mean << ", \"stddev\": " << st.stddev
+          << ", \"ci95\": [" << st.mean - st.ci95 << ", " << st.mean + st.ci95 << "] }\n}" << endl;
+  }
 
-      file.close();
+  else if (format == "csv")
+  {
+      out << "run,position,nodes,time,nps,depth,seldepth,hashfull,tbhits,bestmove" << endl;
+
+      for (int r = 0; r < runs; ++r)
+          for (size_t i = 0; i < fens.size(); ++i)
+          {
+              const Result& res = results[r][i];
+
+              out << r + 1 << ',' << i + 1 << ',' << res.nodes << ',' << res.time
+                  << ',' << 1000 * res.nodes / (res.time + 1) << ',' << res.depth
+                  << ',' << res.selDepth << ',' << res.hashfull << ',' << res.tbHits
+                  << ',' << UCI::move(res.bestMove, pos.is_chess960()) << endl;
+          }
+
+      // Run totals, depth and the other per-position fields are left empty
+      for (int r = 0; r < runs; ++r)
+      {
+          uint64_t tbHits = 0;
+
+          for (const Result& res : results[r])
+              tbHits += res.tbHits;
+
+          out << r + 1 << ",all," << nodes[r] << ',' << elapsed[r] << ','
+              << uint64_t(nps[r]) << ",,,," << tbHits << ',' << endl;
+      }
   }
 
+  cerr << "\n==========================="
+       << "\nTotal time (ms) : " << elapsed.back()
+       << "\nNodes searched  : " << nodes.back()
+       << "\nNodes/second    : " << uint64_t(nps.back()) << endl;
+
+  if (runs > 1)
+      cerr << fixed << setprecision(0)
+           << "Runs            : " << runs
+           << "\nNodes/second    : " << s.mean << " +/- " << s.ci95
+           << " (95% CI, stddev " << s.stddev << ", " << setprecision(2)
+           << 100 * s.ci95 / s.mean << "%)" << endl;
+}
+
+
+/// scalebench() measures how the search scales with the number of threads.
+/// It runs the positions once at fixed depth and once at fixed time for
+/// 1, 2, 4, ... threads up to the given maximum (default is the number of
+/// hardware threads) and reports time-to-depth, nodes-to-depth, nodes/second,
+/// speedup and efficiency against the single thread run. Parameters are the
+/// transposition table size, the depth, the movetime in millisecs, the file
+/// with the positions and the maximum number of threads. When run under MPI
+/// every rank takes part in each search: nodes are summed and times are the
+/// longest among the ranks. Compare rank counts by running with each of them.
+
+void scalebench(const Position& current, istream& is) {
+
+  string token;
+  vector<string> fens;
+  vector<int> threads;
+  Search::LimitsType depthLimits, timeLimits;
+
+  string ttSize  = (is >> token) ? token : "16";
+  int depth      = (is >> token) ? stoi(token) : 13;
+  int movetime   = (is >> token) ? stoi(token) : 1000;
+  string fenFile = (is >> token) ? token : "default";
+  int maxThreads = (is >> token) ? stoi(token) : int(std::thread::hardware_concurrency());
+
+  if (!read_fens(current, fenFile, fens))
+      return;
+
+  maxThreads = std::min(std::max(maxThreads, 1), 512);
+
+  for (int t = 1; t < maxThreads; t *= 2)
+      threads.push_back(t);
+
+  threads.push_back(maxThreads);
+
+  depthLimits.depth = depth;
+  timeLimits.movetime = movetime;
+  Options["Hash"] = ttSize;
+
+  // Per thread count: time and nodes to depth, nodes, time and summed depth at fixed time
+  vector<uint64_t> ttd, ntd, nodes, times, depths;
+  Position pos;
+
+  info_out.silent = true;
+
+  for (int t : threads)
+  {
+      // Nodes to depth, nodes and summed depth at fixed time, then the times
+      uint64_t v[5] = {}, sum[5];
+
+      Options["Threads"] = std::to_string(t);
+
+      for (Search::LimitsType* limits : { &depthLimits, &timeLimits })
+      {
+          bool fixedDepth = limits == &depthLimits;
+
+          Search::clear();
+
+          for (size_t i = 0; i < fens.size(); ++i)
+          {
+              cerr << "\rThreads " << t << (fixedDepth ? " depth " : " time ")
+                   << "position " << i + 1 << '/' << fens.size() << "   " << flush;
+
+              Result res = run(pos, fens[i], *limits, false);
+
+              (fixedDepth ? v[0] : v[1]) += res.nodes;
+              (fixedDepth ? v[3] : v[4]) += res.time;
+
+              if (!fixedDepth)
+                  v[2] += res.depth;
+          }
+      }
+
+      // Nodes and depths are summed over the ranks, times are the slowest rank
+      MPI_Allreduce(v, sum, 3, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+      MPI_Allreduce(&v[3], &sum[3], 2, MPI_UINT64_T, MPI_MAX, MPI_COMM_WORLD);
+
+      ntd.push_back(sum[0]);
+      nodes.push_back(sum[1]);
+      depths.push_back(sum[2] / mpi_size);
+      ttd.push_back(sum[3] + 1);
+      times.push_back(sum[4] + 1);
+  }
+
+  info_out.silent = false;
+  cerr << endl;
+
+  std::stringstream ss;
+
+  ss << "Scaling over " << fens.size() << " positions, " << mpi_size << " rank(s)"
+     << fixed << setprecision(2)
+     << "\n\nFixed depth " << depth
+     << "\n Threads   Time (ms)          Nodes   Speedup  Efficiency";
+
+  for (size_t i = 0; i < threads.size(); ++i)
+  {
+      double speedup = double(ttd[0]) / ttd[i];
+
+      ss << "\n" << setw(8) << threads[i] << setw(12) << ttd[i] << setw(15) << ntd[i]
+         << setw(10) << speedup << setw(12) << speedup / threads[i];
+  }
+
+  ss << "\n\nFixed time " << movetime << " ms"
+     << "\n Threads  Nodes/second   Speedup  Efficiency   Avg depth";
+
+  for (size_t i = 0; i < threads.size(); ++i)
+  {
+      double speedup = double(nodes[i]) * times[0] / (double(nodes[0]) * times[i]);
+
+      ss << "\n" << setw(8) << threads[i]
+         << setw(14) << 1000 * nodes[i] / times[i]
+         << setw(10) << speedup << setw(12) << speedup / threads[i]
+         << setw(12) << double(depths[i]) / fens.size();
+  }
+
+  sync_info_out << ss.str() << sync_info_endl;
+}
+
+
+/// epdbench() runs a test suite of EPD positions with best move (bm) or
+/// avoid move (am) operations and measures how fast they are solved. Each
+/// position is searched for the given time in millisecs (default 10000) with
+/// the given hash size and number of threads. A position is solved when the
+/// move played satisfies its operations; the time and nodes to solution are
+/// those of the iteration from which the main thread kept that move until
+/// the end. It reports the solved count and the geometric mean of the times
+/// to solution of the solved positions.
+
+void epdbench(const Position& current, istream& is) {
+
+  string token, fenFile, line;
+  vector<string> lines;
+
+  if (!(is >> fenFile) || !read_fens(current, fenFile, lines))
+  {
+      cerr << "Usage: epdbench <file> [movetime] [hash] [threads]" << endl;
+      return;
+  }
+
+  Search::LimitsType limits;
+
+  limits.movetime    = (is >> token) ? stoi(token) : 10000;
+  Options["Hash"]    = (is >> token) ? token : "16";
+  Options["Threads"] = (is >> token) ? token : "1";
+
+  size_t solved = 0, total = 0;
+  double logTime = 0;
   uint64_t nodes = 0;
-  TimePoint elapsed = now();
   Position pos;
+  std::stringstream ss;
+
+  info_out.silent = true;
 
-  for (size_t i = 0; i < fens.size(); ++i)
+  for (size_t i = 0; i < lines.size(); ++i)
   {
-      StateListPtr states(new std::deque<StateInfo>(1));
-      pos.set(fens[i], Options["UCI_Chess960"], &states->back(), Threads.main());
+      // An EPD record holds the first four FEN fields, then operations ended
+      // by ';', e.g. "bm Nf3 Qd2; id \"test 1\";"
+      std::istringstream epd(lines[i]);
+      string fen, field, op, id;
+      vector<string> bm, am;
+
+      for (int f = 0; f < 4 && epd >> field; ++f)
+          fen += field + " ";
+
+      StateInfo st;
+      pos.set(fen, Options["UCI_Chess960"], &st, Threads.main());
+
+      while (getline(epd >> std::ws, line, ';'))
+      {
+          std::istringstream ops(line);
+          ops >> op;
+
+          if (op == "id")
+              getline(ops >> std::ws, id);
+
+          while ((op == "bm" || op == "am") && ops >> token)
+          {
+              Move m = parse_move(pos, token);
+
+              if (m == MOVE_NONE)
+                  cerr << "\nIllegal move " << token << " in line " << i + 1 << endl;
+              else
+                  (op == "bm" ? bm : am).push_back(UCI::move(m, pos.is_chess960()));
+          }
+      }
+
+      if (bm.empty() && am.empty())
+          continue;
+
+      cerr << "\rPosition " << i + 1 << '/' << lines.size() << flush;
 
-      cerr << "\nPosition: " << i + 1 << '/' << fens.size() << endl;
+      Search::clear();
+      Result res = run(pos, fen, limits, false);
+      MainThread* main = Threads.main();
+      string played = UCI::move(res.bestMove, pos.is_chess960());
 
-      if (limitType == "perft")
-          nodes += Search::perft(pos, limits.depth * ONE_PLY);
+      bool ok =   (bm.empty() || std::count(bm.begin(), bm.end(), played))
+               && !std::count(am.begin(), am.end(), played);
 
-      else
+      // When a helper thread's move was played take the whole search time
+      bool stable = main->lastBestMove == res.bestMove;
+      TimePoint time = stable ? main->lastBestMoveTime : res.time;
+      uint64_t n = stable ? main->lastBestMoveNodes : res.nodes;
+
+      ++total;
+
+      ss << "\n" << setw(4) << i + 1 << ' ' << (ok ? "solved " : "failed ")
+         << setw(6) << played << setw(10) << (ok ? std::to_string(time) : "-")
+         << setw(14) << (ok ? std::to_string(n) : "-") << "  " << id;
+
+      if (ok)
       {
-          limits.startTime = now();
-          Threads.start_thinking(pos, states, limits);
-          Threads.main()->wait_for_search_finished();
-          nodes += Threads.nodes_searched();
+          ++solved;
+          nodes += n;
+          logTime += std::log(double(std::max(time, TimePoint(1))));
       }
   }
 
-  elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+  info_out.silent = false;
+  cerr << endl;
 
-  dbg_print(); // Just before exiting
-
-  cerr << "\n==========================="
-       << "\nTotal time (ms) : " << elapsed
-       << "\nNodes searched  : " << nodes
-       << "\nNodes/second    : " << 1000 * nodes / elapsed << endl;
+  sync_info_out << "   # result  move  time (ms)         nodes  id" << ss.str()
+                << "\n\nSolved " << solved << '/' << total
+                << fixed << setprecision(1)
+                << "\nGeometric mean time to solution (ms) : "
+                << (solved ? std::exp(logTime / solved) : 0.0)
+                << "\nTotal nodes to solution              : " << nodes
+                << sync_info_endl;
 }
@@ -27,15 +27,119 @@ uint8_t PopCnt16[1 << 16];
 int SquareDistance[SQUARE_NB][SQUARE_NB];
 
 Bitboard  RookMasks  [SQUARE_NB];
-Bitboard  RookMagics [SQUARE_NB];
-Bitboard* RookAttacks[SQUARE_NB];
+SliderEntry* RookAttacks[SQUARE_NB];
 unsigned  RookShifts [SQUARE_NB];
 
 Bitboard  BishopMasks  [SQUARE_NB];
-Bitboard  BishopMagics [SQUARE_NB];
-Bitboard* BishopAttacks[SQUARE_NB];
+SliderEntry* BishopAttacks[SQUARE_NB];
 unsigned  BishopShifts [SQUARE_NB];
 
+// Precomputed magic numbers for the "fancy" magic bitboards, found offline with
+// a trial and error search over sparse random numbers, so that startup does not
+// have to repeat it. The 32 bit index folds the two halves of the occupancy and
+// so needs its own set of magics.
+#if defined(IS_64BIT)
+
+extern const Bitboard RookMagics[SQUARE_NB] = {
+    0x0880004000108025ULL, 0x8040004010002008ULL, 0x2080200010008008ULL, 0x1100100008210004ULL,
+    0xC200209084020008ULL, 0x2100010004000208ULL, 0x0400081000822421ULL, 0x0200010422048844ULL,
+    0x0800800080400024ULL, 0x0001402000401000ULL, 0x3000801000802001ULL, 0x4400800800100083ULL,
+    0x0904802402480080ULL, 0x4040800400020080ULL, 0x0018808042000100ULL, 0x4040800080004100ULL,
+    0x0040048001458024ULL, 0x00A0004000205000ULL, 0x3100808010002000ULL, 0x4825010010000820ULL,
+    0x5004808008000401ULL, 0x2024818004000A00ULL, 0x0005808002000100ULL, 0x2100060004806104ULL,
+    0x0080400880008421ULL, 0x4062220600410280ULL, 0x010A004A00108022ULL, 0x0000100080080080ULL,
+    0x0021000500080010ULL, 0x0044000202001008ULL, 0x0000100400080102ULL, 0xC020128200040545ULL,
+    0x0080002000400040ULL, 0x0000804000802004ULL, 0x0000120022004080ULL, 0x010A386103001001ULL,
+    0x9010080080800400ULL, 0x8440020080800400ULL, 0x0004228824001001ULL, 0x000000490A000084ULL,
+    0x0080002000504000ULL, 0x200020005000C000ULL, 0x0012088020420010ULL, 0x0010010080080800ULL,
+    0x0085001008010004ULL, 0x0002000204008080ULL, 0x0040413002040008ULL, 0x0000304081020004ULL,
+    0x0080204000800080ULL, 0x3008804000290100ULL, 0x1010100080200080ULL, 0x2008100208028080ULL,
+    0x5000850800910100ULL, 0x8402019004680200ULL, 0x0120911028020400ULL, 0x0000008044010200ULL,
+    0x0020850200244012ULL, 0x0020850200244012ULL, 0x0000102001040841ULL, 0x140900040A100021ULL,
+    0x000200282410A102ULL, 0x000200282410A102ULL, 0x000200282410A102ULL, 0x4048240043802106ULL };
+
+extern const Bitboard BishopMagics[SQUARE_NB] = {
+    0x02B1200800822140ULL, 0x0020010250810120ULL, 0x2010010220280081ULL, 0x002806004050C040ULL,
+    0x0002021018000000ULL, 0x2001112010000400ULL, 0x0881010120218080ULL, 0x1030820110010500ULL,
+    0x0000120222042400ULL, 0x2000020404040044ULL, 0x8000480094208000ULL, 0x0003422A02000001ULL,
+    0x000A220210100040ULL, 0x8004820202226000ULL, 0x0018234854100800ULL, 0x0100004042101040ULL,
+    0x0004001004082820ULL, 0x0010000810010048ULL, 0x1014004208081300ULL, 0x2080818802044202ULL,
+    0x0040880C00A00100ULL, 0x0080400200522010ULL, 0x0001000188180B04ULL, 0x0080249202020204ULL,
+    0x1004400004100410ULL, 0x00013100A0022206ULL, 0x2148500001040080ULL, 0x4241080011004300ULL,
+    0x4020848004002000ULL, 0x10101380D1004100ULL, 0x0008004422020284ULL, 0x01010A1041008080ULL,
+    0x0808080400082121ULL, 0x0808080400082121ULL, 0x0091128200100C00ULL, 0x0202200802010104ULL,
+    0x8C0A020200440085ULL, 0x01A0008080B10040ULL, 0x0889520080122800ULL, 0x100902022202010AULL,
+    0x04081A0816002000ULL, 0x0000681208005000ULL, 0x8170840041008802ULL, 0x0A00004200810805ULL,
+    0x0830404408210100ULL, 0x2602208106006102ULL, 0x1048300680802628ULL, 0x2602208106006102ULL,
+    0x0602010120110040ULL, 0x0941010801043000ULL, 0x000040440A210428ULL, 0x0008240020880021ULL,
+    0x0400002012048200ULL, 0x00AC102001210220ULL, 0x0220021002009900ULL, 0x84440C080A013080ULL,
+    0x0001008044200440ULL, 0x0004C04410841000ULL, 0x2000500104011130ULL, 0x1A0C010011C20229ULL,
+    0x0044800112202200ULL, 0x0434804908100424ULL, 0x0300404822C08200ULL, 0x48081010008A2A80ULL };
+
+#else
+
+extern const Bitboard RookMagics[SQUARE_NB] = {
+    0x1100400000808020ULL, 0x1100400000808020ULL, 0x00200A10E0800890ULL, 0x010A00C000800410ULL,
+    0x9080084080810404ULL, 0x04081A0481000201ULL, 0x48600480102008A1ULL, 0x8201228080801249ULL,
+    0x0100500000440204ULL, 0x1020031000200804ULL, 0x2010802000082008ULL, 0x2010802000082008ULL,
+    0x20500806801A0022ULL, 0x20500806801A0022ULL, 0x038421000A008022ULL, 0x0108442002200811ULL,
+    0x8002C02009010202ULL, 0x2041200441100040ULL, 0x2400300100004420ULL, 0x0400090210004042ULL,
+    0x0580100800080102ULL, 0x03100C0020020202ULL, 0x0005020048820101ULL, 0x2491040100000201ULL,
+    0x1080010200424021ULL, 0x3042050080908022ULL, 0x004820802C020212ULL, 0x1010006420000921ULL,
+    0x58CC050008229801ULL, 0x0014400200408901ULL, 0xC008104230680104ULL, 0x0D00048201380041ULL,
+    0x0040105040900823ULL, 0x0040105040900823ULL, 0x0080220600008610ULL, 0x0080502010008289ULL,
+    0x1640040011120008ULL, 0x0080048000A41102ULL, 0x0040010000028C4AULL, 0x0081004000009601ULL,
+    0x0020800000049050ULL, 0x2020200802409009ULL, 0x0184202200080441ULL, 0x0821000800210010ULL,
+    0x0302040201006208ULL, 0x0400402220054302ULL, 0x004020808200E001ULL, 0x0400404030110081ULL,
+    0x0040302000900080ULL, 0x60108080C0086941ULL, 0x041010200C002106ULL, 0x801180800810400AULL,
+    0x041010200C002106ULL, 0x0890C80401002004ULL, 0x11B0201000104082ULL, 0x0180028090800871ULL,
+    0x0280006104304013ULL, 0x00A1405140040221ULL, 0x2011482520086005ULL, 0x0404405290881822ULL,
+    0x12508C220A640482ULL, 0x0818211260000402ULL, 0x0012008104000A85ULL, 0x20009023018000C1ULL };
+
+extern const Bitboard BishopMagics[SQUARE_NB] = {
+    0x080205C0100C014AULL, 0x0080200710301002ULL, 0x4221080080049122ULL, 0x1000124640080581ULL,
+    0x84084410001450C0ULL, 0x900808020A060104ULL, 0x0848401C04C0D808ULL, 0x01100A40C3808528ULL,
+    0x4801304440803027ULL, 0x024081202006901BULL, 0x8606120002000401ULL, 0x0880102091A82404ULL,
+    0x1040002A20030A32ULL, 0x44201A0160021091ULL, 0x1008080104402244ULL, 0x0182203100450909ULL,
+    0x12100C4302280010ULL, 0x9A58410212580017ULL, 0x0142058800102009ULL, 0x0620A00400008104ULL,
+    0x0301148200010002ULL, 0x8900900800204026ULL, 0x0105200108024202ULL, 0x00420A0410804092ULL,
+    0x4802086023601201ULL, 0x1811040840B00600ULL, 0x0900C20004031000ULL, 0x2010201840004400ULL,
+    0x0080805008101440ULL, 0x0080A00C11006100ULL, 0x0424010600114904ULL, 0x0424010600114904ULL,
+    0x1220200802021804ULL, 0x0814040000015102ULL, 0x0006C10180040C04ULL, 0x401880A000000208ULL,
+    0x0812480883820042ULL, 0x0080808025149011ULL, 0x0006C10180040C04ULL, 0x0101C2007000812AULL,
+    0x2402120200880202ULL, 0x0863244230004108ULL, 0x0120820000114108ULL, 0x2090110022400099ULL,
+    0x1410020240000202ULL, 0xB040822001411001ULL, 0x020031000204012AULL, 0x81420500109001C1ULL,
+    0x0828000078040105ULL, 0x0402063624084424ULL, 0x40B0000124240049ULL, 0x504400000C040252ULL,
+    0x020A050102880092ULL, 0x100220000130A004ULL, 0x008108540051302BULL, 0x708028A2008D1044ULL,
+    0x10940401000A0101ULL, 0x0118244024002821ULL, 0x8406062000441221ULL, 0x020A020000030108ULL,
+    0x10020225200102A0ULL, 0x02C6220020400120ULL, 0x080E910800104144ULL, 0x50C200800A982129ULL };
+
+#endif
+
+#if defined(USE_COMPACT_ATTACKS)
+namespace {
+
+  // A ray of n > 0 squares gives n distinct attacks, ended by a blocker on any
+  // of its squares or by the edge, and an empty ray gives one. The distinct
+  // attacks of a slider on a square are the product over its four rays.
+  constexpr int rays(int n1, int n2, int n3, int n4) {
+    return (n1 ? n1 : 1) * (n2 ? n2 : 1) * (n3 ? n3 : 1) * (n4 ? n4 : 1);
+  }
+
+  constexpr int lesser(int a, int b) { return a < b ? a : b; }
+
+  // Sum over the squares from 's' on of their distinct rook and bishop attacks
+  constexpr int distinct_attacks(int s = 0) {
+    return s == 64 ? 0 : rays(s & 7, 7 - (s & 7), s >> 3, 7 - (s >> 3))
+                       + rays(lesser(s & 7, s >> 3), lesser(7 - (s & 7), s >> 3),
+                              lesser(s & 7, 7 - (s >> 3)), lesser(7 - (s & 7), 7 - (s >> 3)))
+                       + distinct_attacks(s + 1);
+  }
+}
+
+Bitboard SliderAttacks[1 + distinct_attacks()]; // Distinct rook and bishop attacks of each square
+#endif
+
 Bitboard SquareBB[SQUARE_NB];
 Bitboard FileBB[FILE_NB];
 Bitboard RankBB[RANK_NB];
@@ -58,13 +162,17 @@ namespace {
 
   int MSBTable[256];            // To implement software msb()
   Square BSFTable[SQUARE_NB];   // To implement software bitscan
-  Bitboard RookTable[0x19000];  // To store rook attacks
-  Bitboard BishopTable[0x1480]; // To store bishop attacks
+  SliderEntry RookTable[0x19000];  // To store rook attacks
+  SliderEntry BishopTable[0x1480]; // To store bishop attacks
+
+#if defined(USE_COMPACT_ATTACKS)
+  int SliderAttacksCount = 1; // Entry 0 is reserved for empty table slots
+#endif
 
   typedef unsigned (Fn)(Square, Bitboard);
 
-  void init_magics(Bitboard table[], Bitboard* attacks[], Bitboard magics[],
-                   Bitboard masks[], unsigned shifts[], Square deltas[], Fn index);
+  void init_magics(SliderEntry table[], SliderEntry* attacks[], Bitboard masks[],
+                   unsigned shifts[], Square deltas[], Fn index);
 
   // bsf_index() returns the index into BSFTable[] to look up the bitscan. Uses
   // Matt Taylor's folding for 32 bit case, extended to 64 bit by Kim Walisch.
@@ -212,8 +320,12 @@ void Bitboards::init() {
   Square RookDeltas[] = { NORTH,  EAST,  SOUTH,  WEST };
   Square BishopDeltas[] = { NORTH_EAST, SOUTH_EAST, SOUTH_WEST, NORTH_WEST };
 
-  init_magics(RookTable, RookAttacks, RookMagics, RookMasks, RookShifts, RookDeltas, magic_index<ROOK>);
-  init_magics(BishopTable, BishopAttacks, BishopMagics, BishopMasks, BishopShifts, BishopDeltas, magic_index<BISHOP>);
+  init_magics(RookTable, RookAttacks, RookMasks, RookShifts, RookDeltas, magic_index<ROOK>);
+  init_magics(BishopTable, BishopAttacks, BishopMasks, BishopShifts, BishopDeltas, magic_index<BISHOP>);
+
+#if defined(USE_COMPACT_ATTACKS)
+  assert(SliderAttacksCount == int(sizeof(SliderAttacks) / sizeof(Bitboard)));
+#endif
 
   for (Square s1 = SQ_A1; s1 <= SQ_H8; ++s1)
   {
@@ -257,16 +369,17 @@ namespace {
   // init_magics() computes all rook and bishop attacks at startup. Magic
   // bitboards are used to look up attacks of sliding pieces. As a reference see
   // chessprogramming.wikispaces.com/Magic+Bitboards. In particular, here we
-  // use the so called "fancy" approach.
-
-  void init_magics(Bitboard table[], Bitboard* attacks[], Bitboard magics[],
-                   Bitboard masks[], unsigned shifts[], Square deltas[], Fn index) {
+  // use the so called "fancy" approach. The magics themselves are precomputed
+  // (see RookMagics[] and BishopMagics[]), so only the tables are filled here.
 
-    int seeds[][RANK_NB] = { { 8977, 44560, 54343, 38998,  5731, 95205, 104912, 17020 },
-                             {  728, 10316, 55013, 32803, 12281, 15100,  16645,   255 } };
+  void init_magics(SliderEntry table[], SliderEntry* attacks[], Bitboard masks[],
+                   unsigned shifts[], Square deltas[], Fn index) {
 
-    Bitboard occupancy[4096], reference[4096], edges, b;
-    int age[4096] = {0}, current = 0, i, size;
+    Bitboard edges, b;
+    int size;
+#if defined(USE_COMPACT_ATTACKS)
+    int first;
+#endif
 
     // attacks[s] is a pointer to the beginning of the attacks table for square 's'
     attacks[SQ_A1] = table;
@@ -285,15 +398,38 @@ namespace {
         shifts[s] = (Is64Bit ? 64 : 32) - popcount(masks[s]);
 
         // Use Carry-Rippler trick to enumerate all subsets of masks[s] and
-        // store the corresponding sliding attack bitboard in reference[].
+        // store the corresponding sliding attack bitboard in the table. A good
+        // magic maps occupancies with different attacks to different entries,
+        // and the table starts zeroed while every sliding attack is non-empty.
         b = size = 0;
+#if defined(USE_COMPACT_ATTACKS)
+        first = SliderAttacksCount;
+#endif
         do {
-            occupancy[size] = b;
-            reference[size] = sliding_attack(deltas, s, b);
+            Bitboard attack = sliding_attack(deltas, s, b);
+            unsigned idx = index(s, b);
 
-            if (HasPext)
-                attacks[s][pext(b, masks[s])] = reference[size];
+#if defined(USE_COMPACT_ATTACKS)
+            // Look for the attack among the pool entries added for 's', so that
+            // the pool ends up with the distinct attacks of every square.
+            int e = first;
+            while (e < SliderAttacksCount && SliderAttacks[e] != attack)
+                ++e;
 
+            if (e == SliderAttacksCount)
+            {
+                assert(e < int(sizeof(SliderAttacks) / sizeof(Bitboard)));
+                SliderAttacks[SliderAttacksCount++] = attack;
+            }
+
+            assert(!attacks[s][idx] || attacks[s][idx] == e);
+
+            attacks[s][idx] = SliderEntry(e);
+#else
+            assert(!attacks[s][idx] || attacks[s][idx] == attack);
+
+            attacks[s][idx] = attack;
+#endif
             size++;
             b = (b - masks[s]) & masks[s];
         } while (b);
@@ -302,36 +438,6 @@ namespace {
         // table sizes for each square with "Fancy Magic Bitboards".
         if (s < SQ_H8)
             attacks[s + 1] = attacks[s] + size;
-
-        if (HasPext)
-            continue;
-
-        PRNG rng(seeds[Is64Bit][rank_of(s)]);
-
-        // Find a magic for square 's' picking up an (almost) random number
-        // until we find the one that passes the verification test.
-        do {
-            do
-                magics[s] = rng.sparse_rand<Bitboard>();
-            while (popcount((magics[s] * masks[s]) >> 56) < 6);
-
-            // A good magic must map every possible occupancy to an index that
-            // looks up the correct sliding attack in the attacks[s] database.
-            // Note that we build up the database for square 's' as a side
-            // effect of verifying the magic.
-            for (++current, i = 0; i < size; ++i)
-            {
-                unsigned idx = index(s, occupancy[i]);
-
-                if (age[idx] < current)
-                {
-                    age[idx] = current;
-                    attacks[s][idx] = reference[i];
-                }
-                else if (attacks[s][idx] != reference[i])
-                    break;
-            }
-        } while (i < size);
     }
   }
 }
@@ -209,6 +209,18 @@ template<> inline int distance<File>(Square x, Square y) { return distance(file_
 template<> inline int distance<Rank>(Square x, Square y) { return distance(rank_of(x), rank_of(y)); }
 
 
+/// With USE_COMPACT_ATTACKS the per-square slider tables do not store the
+/// attacks themselves but 16 bit indices into SliderAttacks[], a small pool with
+/// the distinct attack bitboards of each square, deduplicated per square only.
+/// This shrinks the tables to a quarter of their size, at the cost of a second
+/// load from the pool.
+#if defined(USE_COMPACT_ATTACKS)
+typedef uint16_t SliderEntry;
+#else
+typedef Bitboard SliderEntry;
+#endif
+
+
 /// attacks_bb() returns a bitboard representing all the squares attacked by a
 /// piece of type Pt (bishop or rook) placed on 's'. The helper magic_index()
 /// looks up the index using the 'magic bitboards' approach.
@@ -216,14 +228,14 @@ template<PieceType Pt>
 inline unsigned magic_index(Square s, Bitboard occupied) {
 
   extern Bitboard RookMasks[SQUARE_NB];
-  extern Bitboard RookMagics[SQUARE_NB];
+  extern const Bitboard RookMagics[SQUARE_NB];
   extern unsigned RookShifts[SQUARE_NB];
   extern Bitboard BishopMasks[SQUARE_NB];
-  extern Bitboard BishopMagics[SQUARE_NB];
+  extern const Bitboard BishopMagics[SQUARE_NB];
   extern unsigned BishopShifts[SQUARE_NB];
 
   Bitboard* const Masks  = Pt == ROOK ? RookMasks  : BishopMasks;
-  Bitboard* const Magics = Pt == ROOK ? RookMagics : BishopMagics;
+  const Bitboard* Magics = Pt == ROOK ? RookMagics : BishopMagics;
   unsigned* const Shifts = Pt == ROOK ? RookShifts : BishopShifts;
 
   if (HasPext)
@@ -240,10 +252,17 @@ inline unsigned magic_index(Square s, Bitboard occupied) {
 template<PieceType Pt>
 inline Bitboard attacks_bb(Square s, Bitboard occupied) {
 
-  extern Bitboard* RookAttacks[SQUARE_NB];
-  extern Bitboard* BishopAttacks[SQUARE_NB];
+  extern SliderEntry* RookAttacks[SQUARE_NB];
+  extern SliderEntry* BishopAttacks[SQUARE_NB];
+
+  SliderEntry e = (Pt == ROOK ? RookAttacks : BishopAttacks)[s][magic_index<Pt>(s, occupied)];
 
-  return (Pt == ROOK ? RookAttacks : BishopAttacks)[s][magic_index<Pt>(s, occupied)];
+#if defined(USE_COMPACT_ATTACKS)
+  extern Bitboard SliderAttacks[];
+  return SliderAttacks[e];
+#else
+  return e;
+#endif
 }
 
 inline Bitboard attacks_bb(PieceType pt, Square s, Bitboard occupied) {
@@ -260,6 +279,102 @@ inline Bitboard attacks_bb(PieceType pt, Square s, Bitboard occupied) {
 }
 
 
+/// Vectorized sliding attacks. With USE_AVX2 each 64 bit lane of a vector holds
+/// the bitboard of one slider, so that four (eight with USE_AVX512) sliders are
+/// filled at the same time with the Kogge-Stone algorithm. As a reference see
+/// chessprogramming.wikispaces.com/Kogge-Stone+Algorithm.
+#if defined(USE_AVX2)
+
+namespace Simd {
+
+#if defined(USE_AVX512)
+typedef __m512i Vec;
+inline Vec set1(Bitboard b) { return _mm512_set1_epi64(int64_t(b)); }
+inline Vec load(const Bitboard* p) { return _mm512_loadu_si512(p); }
+inline void store(Bitboard* p, Vec v) { _mm512_storeu_si512(p, v); }
+inline Vec and_(Vec a, Vec b) { return _mm512_and_si512(a, b); }
+inline Vec or_(Vec a, Vec b) { return _mm512_or_si512(a, b); }
+template<int D> inline Vec shift(Vec v) { return D > 0 ? _mm512_slli_epi64(v, D > 0 ? D : 0) : _mm512_srli_epi64(v, D < 0 ? -D : 0); }
+#else
+typedef __m256i Vec;
+inline Vec set1(Bitboard b) { return _mm256_set1_epi64x(int64_t(b)); }
+inline Vec load(const Bitboard* p) { return _mm256_loadu_si256((const __m256i*)p); }
+inline void store(Bitboard* p, Vec v) { _mm256_storeu_si256((__m256i*)p, v); }
+inline Vec and_(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+inline Vec or_(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+template<int D> inline Vec shift(Vec v) { return D > 0 ? _mm256_slli_epi64(v, D > 0 ? D : 0) : _mm256_srli_epi64(v, D < 0 ? -D : 0); }
+#endif
+
+const int Lanes = sizeof(Vec) / sizeof(Bitboard);
+
+/// sliding_attack() returns the attacks of the sliders in 'gen' along direction
+/// D, given the empty squares of the board. Squares that would wrap around the
+/// board edge are masked out of the propagator and of the result.
+template<int D>
+inline Vec sliding_attack(Vec gen, Vec empty) {
+
+  const Bitboard NoWrap = D == EAST || D == NORTH_EAST || D == SOUTH_EAST ? ~FileABB
+                        : D == WEST || D == NORTH_WEST || D == SOUTH_WEST ? ~FileHBB
+                                                                          : ~Bitboard(0);
+  const Vec noWrap = set1(NoWrap);
+  Vec pro = and_(empty, noWrap);
+
+  gen = or_(gen, and_(pro, shift<    D>(gen)));
+  pro = and_(pro, shift<D>(pro));
+  gen = or_(gen, and_(pro, shift<2 * D>(gen)));
+  pro = and_(pro, shift<2 * D>(pro));
+  gen = or_(gen, and_(pro, shift<4 * D>(gen)));
+
+  return and_(shift<D>(gen), noWrap);
+}
+
+} // namespace Simd
+
+#endif
+
+
+/// attacks_bb() batched version stores in attacks[] the attacks of the pieces of
+/// type Pt (bishop or rook) placed on the SQ_NONE terminated square list 'pl'.
+/// Without USE_AVX2 it does one attacks_bb() lookup per piece.
+template<PieceType Pt>
+inline void attacks_bb(const Square* pl, Bitboard occupied, Bitboard* attacks) {
+
+#if defined(USE_AVX2)
+
+  using namespace Simd;
+
+  const Vec empty = set1(~occupied);
+  Bitboard sliders[Lanes], result[Lanes];
+  int n;
+
+  while (*pl != SQ_NONE)
+  {
+      for (n = 0; n < Lanes && *pl != SQ_NONE; ++n)
+          sliders[n] = SquareBB[*pl++];
+
+      for (int i = n; i < Lanes; ++i)
+          sliders[i] = 0;
+
+      Vec gen = load(sliders);
+
+      store(result, Pt == ROOK ? or_(or_(sliding_attack<NORTH>(gen, empty), sliding_attack<SOUTH>(gen, empty)),
+                                     or_(sliding_attack<EAST >(gen, empty), sliding_attack<WEST >(gen, empty)))
+                               : or_(or_(sliding_attack<NORTH_EAST>(gen, empty), sliding_attack<SOUTH_EAST>(gen, empty)),
+                                     or_(sliding_attack<NORTH_WEST>(gen, empty), sliding_attack<SOUTH_WEST>(gen, empty))));
+
+      for (int i = 0; i < n; ++i)
+          *attacks++ = result[i];
+  }
+
+#else
+
+  for ( ; *pl != SQ_NONE; ++pl)
+      *attacks++ = attacks_bb<Pt>(*pl, occupied);
+
+#endif
+}
+
+
 /// popcount() counts the number of non-zero bits in a bitboard
 
 inline int popcount(Bitboard b) {
@@ -269,17 +269,28 @@ namespace {
                                                : Rank5BB | Rank4BB | Rank3BB);
     const Square* pl = pos.squares<Pt>(Us);
 
-    Bitboard b, bb;
+    // Occupancy seen by our sliders, for x-ray attacks through our own pieces
+    const Bitboard xray = Pt == BISHOP ? pos.pieces() ^ pos.pieces(Us, QUEEN)
+                                       : pos.pieces() ^ pos.pieces(Us, ROOK, QUEEN);
+
+    Bitboard b, bb, sliderAttacks[16];
+    const Bitboard* sa = sliderAttacks;
     Square s;
     Score score = SCORE_ZERO;
 
     ei.attackedBy[Us][Pt] = 0;
 
+    // With vector instructions the attacks of all our bishops or rooks are
+    // computed at once, before the per-piece loop.
+    if (HasAvx2 && (Pt == BISHOP || Pt == ROOK))
+        attacks_bb<Pt == ROOK ? ROOK : BISHOP>(pl, xray, sliderAttacks);
+
     while ((s = *pl++) != SQ_NONE)
     {
         // Find attacked squares, including x-ray attacks for bishops and rooks
-        b = Pt == BISHOP ? attacks_bb<BISHOP>(s, pos.pieces() ^ pos.pieces(Us, QUEEN))
-          : Pt ==   ROOK ? attacks_bb<  ROOK>(s, pos.pieces() ^ pos.pieces(Us, ROOK, QUEEN))
+        b = HasAvx2 && (Pt == BISHOP || Pt == ROOK) ? *sa++
+          : Pt == BISHOP ? attacks_bb<BISHOP>(s, xray)
+          : Pt ==   ROOK ? attacks_bb<  ROOK>(s, xray)
                          : pos.attacks_from<Pt>(s);
 
         if (pos.pinned_pieces(Us) & s)
@@ -790,6 +801,8 @@ namespace {
 template<bool DoTrace>
 Value Eval::evaluate(const Position& pos) {
 
+  SCOPED_TIMER(TIMER_EVALUATE);
+
   assert(!pos.checkers());
 
   Score mobility[COLOR_NB] = { SCORE_ZERO, SCORE_ZERO };
@@ -77,9 +77,12 @@ void init_mpi(int *argc, char ***argv) {
 int main(int argc, char* argv[]) {
   init_mpi(&argc, &argv);
 
+  // Passed args run a single command, e.g. a bench writing a json report to
+  // stdout, so the banner goes to stderr and the startup info is muted there.
   if (mpi_rank == 0) {
-    std::cout << engine_info() << std::endl;
+    (argc > 1 ? std::cerr : std::cout) << engine_info() << std::endl;
   }
+  info_out.silent = argc > 1;
 
   UCI::init(Options);
   PSQT::init();
@@ -89,8 +92,10 @@ int main(int argc, char* argv[]) {
   Search::init();
   Pawns::init();
   Threads.init();
-  Tablebases::init(Options["SyzygyPath"]);
+  Tablebases::init(Options["SyzygyPath"], Options["SyzygyBackgroundScan"]);
+  Tablebases::preload(Options["SyzygyPreload"], Options["SyzygyLock"]);
   TT.resize(Options["Hash"]);
+  info_out.silent = false;
 
   UCI::loop(argc, argv);
 
@@ -36,6 +36,15 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 }
 #endif
 
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -159,6 +168,249 @@ void dbg_print() {
            << (double)means[1] / means[0] << endl;
 }
 
+/// Scoped timers. Each thread registers its accumulators on first use; the
+/// counts of exited threads are kept in Retired so that timers_print() covers
+/// all the threads that ran since the last timers_clear().
+#ifdef PROFILE_TIMERS
+
+namespace {
+
+Mutex TimersMutex;
+std::vector<ThreadTimers*> TimersList;
+TimerCounts Retired;
+
+void add(TimerCounts& sum, const TimerCounts& c) {
+
+  for (int i = 0; i < TIMER_NB; ++i)
+  {
+      sum.calls[i] += c.calls[i];
+      sum.inclusive[i] += c.inclusive[i];
+      sum.exclusive[i] += c.exclusive[i];
+  }
+}
+
+} // namespace
+
+thread_local ThreadTimers LocalTimers;
+
+ThreadTimers::ThreadTimers() : TimerCounts(), active{}, nested(0) {
+
+  std::unique_lock<Mutex> lk(TimersMutex);
+  TimersList.push_back(this);
+}
+
+ThreadTimers::~ThreadTimers() {
+
+  std::unique_lock<Mutex> lk(TimersMutex);
+  add(Retired, *this);
+  TimersList.erase(std::find(TimersList.begin(), TimersList.end(), this));
+}
+
+void timers_clear() {
+
+  std::unique_lock<Mutex> lk(TimersMutex);
+  Retired = TimerCounts();
+
+  for (ThreadTimers* t : TimersList)
+      *static_cast<TimerCounts*>(t) = TimerCounts();
+}
+
+void timers_print() {
+
+  const char* Names[] = { "search", "qsearch", "evaluate", "next_move", "generate",
+                          "do_move", "undo_move", "tt probe", "see", "tb probe" };
+  TimerCounts sum = TimerCounts();
+  uint64_t total = 0;
+
+  {
+      std::unique_lock<Mutex> lk(TimersMutex);
+      add(sum, Retired);
+
+      for (ThreadTimers* t : TimersList)
+          add(sum, *t);
+  }
+
+  for (int i = 0; i < TIMER_NB; ++i)
+      total += sum.exclusive[i];
+
+  if (!total)
+      return;
+
+  cerr << "\nFunction          Calls   Incl Mcycles  Incl %   Excl Mcycles  Excl %  Cycles/call"
+       << fixed;
+
+  for (int i = 0; i < TIMER_NB; ++i)
+      cerr << "\n" << left << setw(10) << Names[i] << right
+           << setw(13) << sum.calls[i]
+           << setw(15) << setprecision(1) << sum.inclusive[i] / 1e6
+           << setw(8) << 100.0 * sum.inclusive[i] / total
+           << setw(15) << sum.exclusive[i] / 1e6
+           << setw(8) << 100.0 * sum.exclusive[i] / total
+           << setw(13) << setprecision(0) << (sum.calls[i] ? double(sum.exclusive[i]) / sum.calls[i] : 0.0);
+
+  cerr << endl;
+}
+
+#else
+
+void timers_clear() {}
+void timers_print() {}
+
+#endif
+
+/// Hardware performance counters
+
+PerfCounts& PerfCounts::operator+=(const PerfCounts& p) {
+
+  for (int i = 0; i < EVENT_NB; ++i)
+      count[i] += p.count[i];
+
+  valid |= p.valid;
+  return *this;
+}
+
+PerfCounts PerfCounts::operator-(const PerfCounts& p) const {
+
+  PerfCounts d = *this;
+
+  for (int i = 0; i < EVENT_NB; ++i)
+      d.count[i] -= p.count[i];
+
+  return d;
+}
+
+std::string PerfCounts::report(uint64_t nodes) const {
+
+  const char* Names[] = { "cpu ns", "cycles", "instructions", "L1D misses",
+                          "LLC misses", "branch misses", "dTLB misses" };
+  std::stringstream ss;
+
+  if (!valid)
+      return "perf counters not available";
+
+  ss << fixed << setprecision(2) << "perf";
+
+  if ((valid & (1 << CYCLES)) && (valid & (1 << INSTRUCTIONS)) && count[CYCLES])
+      ss << " IPC " << double(count[INSTRUCTIONS]) / count[CYCLES];
+
+  ss << " per node:";
+
+  for (int i = 0; i < EVENT_NB; ++i)
+  {
+      ss << " " << Names[i] << " ";
+
+      if (valid & (1 << i))
+          ss << double(count[i]) / std::max(nodes, uint64_t(1));
+      else
+          ss << "n/a";
+  }
+
+  return ss.str();
+}
+
+PerfCounters::PerfCounters() : opened(false) {
+
+  std::memset(count, 0, sizeof(count));
+  std::fill(fd, fd + EVENT_NB, -1);
+  valid = 0;
+}
+
+PerfCounters::~PerfCounters() {
+
+#ifdef __linux__
+  for (int f : fd)
+      if (f >= 0)
+          close(f);
+#endif
+}
+
+#ifdef __linux__
+
+namespace {
+
+  // Read count, time enabled and time running of an event
+  bool read_event(int fd, uint64_t v[3]) {
+    return read(fd, v, 3 * sizeof(uint64_t)) == 3 * sizeof(uint64_t);
+  }
+
+  uint64_t cache_event(uint64_t cache) {
+    return   cache
+           | PERF_COUNT_HW_CACHE_OP_READ << 8
+           | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+  }
+}
+
+void PerfCounters::start() {
+
+  const struct { uint32_t type; uint64_t config; } Events[] = {
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_L1D) },
+    { PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_LL) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_DTLB) }
+  };
+
+  if (!opened)
+  {
+      opened = true;
+
+      for (int i = 0; i < EVENT_NB; ++i)
+      {
+          perf_event_attr attr;
+          std::memset(&attr, 0, sizeof(attr));
+          attr.size = sizeof(attr);
+          attr.type = Events[i].type;
+          attr.config = Events[i].config;
+          attr.exclude_kernel = attr.exclude_hv = 1;
+          attr.read_format =  PERF_FORMAT_TOTAL_TIME_ENABLED
+                            | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+          // Count the calling thread on any cpu
+          fd[i] = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+
+          if (fd[i] >= 0)
+              valid |= 1 << i;
+      }
+  }
+
+  for (int i = 0; i < EVENT_NB; ++i)
+      if (fd[i] >= 0)
+      {
+          ioctl(fd[i], PERF_EVENT_IOC_ENABLE, 0);
+
+          if (!read_event(fd[i], last[i]))
+              last[i][0] = last[i][1] = last[i][2] = 0;
+      }
+}
+
+void PerfCounters::stop() {
+
+  uint64_t v[3];
+
+  for (int i = 0; i < EVENT_NB; ++i)
+      if (fd[i] >= 0)
+      {
+          ioctl(fd[i], PERF_EVENT_IOC_DISABLE, 0);
+
+          if (!read_event(fd[i], v))
+              continue;
+
+          uint64_t enabled = v[1] - last[i][1], running = v[2] - last[i][2];
+
+          // Scale up the count when the event was not counting all the time
+          count[i] += running ? uint64_t(double(v[0] - last[i][0]) * enabled / running) : 0;
+      }
+}
+
+#else
+
+void PerfCounters::start() {}
+void PerfCounters::stop() {}
+
+#endif
+
 /// Trampoline helper to avoid moving Logger to misc.h
 void start_logger(const std::string& fname) { Logger::start(fname); }
 
@@ -23,11 +23,18 @@
 
 #include <cassert>
 #include <chrono>
+#include <cstring>
 #include <iostream>
 #include <ostream>
 #include <string>
 #include <vector>
 
+#if defined(PROFILE_TIMERS) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h> // For __rdtsc()
+#elif defined(PROFILE_TIMERS) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
 #include "types.h"
 #include "thread_win32.h"
 
@@ -47,6 +54,8 @@ void dbg_hit_on(bool b);
 void dbg_hit_on(bool c, bool b);
 void dbg_mean_of(int v);
 void dbg_print();
+void timers_clear();
+void timers_print();
 
 typedef std::chrono::milliseconds::rep TimePoint; // A value in milliseconds
 
@@ -63,7 +72,12 @@ private:
   std::vector<Entry> table = std::vector<Entry>(Size);
 };
 
-class InfoStream { };
+/// InfoStream prints the engine output on the first MPI rank only. Setting
+/// 'silent' mutes it, e.g. when bench writes a machine-readable report.
+class InfoStream {
+public:
+  bool silent = false;
+};
 extern InfoStream info_out;
 
 enum class SyncCout { IO_LOCK, IO_UNLOCK, IO_ENDL };
@@ -72,7 +86,7 @@ InfoStream& operator<<(InfoStream&, SyncCout);
 template <typename T>
 InfoStream& operator<<(InfoStream& is, const T& t)
 {
-  if (mpi_rank == 0) {
+  if (mpi_rank == 0 && !is.silent) {
     std::cout << t;
   }
   return is;
@@ -92,7 +106,7 @@ inline InfoStream& operator<<(InfoStream& is, SyncCout sc) {
       break;
 
   case SyncCout::IO_ENDL:
-      if (mpi_rank == 0) {
+      if (mpi_rank == 0 && !is.silent) {
         std::cout << std::endl;
       }
       break;
@@ -106,6 +120,122 @@ inline InfoStream& operator<<(InfoStream& is, SyncCout sc) {
 #define sync_info_endl SyncCout::IO_ENDL << SyncCout::IO_UNLOCK
 
 
+/// Scoped timers measure the hot functions of the search when compiled with
+/// 'make profile-timers=yes', otherwise SCOPED_TIMER() expands to nothing. The
+/// cycles spent between the construction and destruction of a ScopedTimer are
+/// added to the accumulators of the calling thread: inclusive time is counted
+/// once per outermost call of a function, so that recursion does not inflate
+/// it, while exclusive time leaves out the timed functions called from it.
+
+enum TimerId {
+  TIMER_SEARCH, TIMER_QSEARCH, TIMER_EVALUATE, TIMER_NEXT_MOVE, TIMER_GENERATE,
+  TIMER_DO_MOVE, TIMER_UNDO_MOVE, TIMER_TT_PROBE, TIMER_SEE, TIMER_TB_PROBE,
+  TIMER_NB
+};
+
+#ifdef PROFILE_TIMERS
+
+struct TimerCounts {
+  uint64_t calls[TIMER_NB], inclusive[TIMER_NB], exclusive[TIMER_NB];
+};
+
+struct ThreadTimers : public TimerCounts {
+  ThreadTimers();  // Registers the timers of the thread for timers_print()
+ ~ThreadTimers();
+  int active[TIMER_NB]; // Calls of each function in progress, for recursion
+  uint64_t nested;      // Cycles of the timed calls made by the current one
+};
+
+extern thread_local ThreadTimers LocalTimers;
+
+inline uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+  return __rdtsc();
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+class ScopedTimer {
+public:
+  explicit ScopedTimer(TimerId t) : id(t), outerNested(LocalTimers.nested) {
+    LocalTimers.nested = 0;
+    LocalTimers.active[id]++;
+    start = cycles();
+  }
+
+ ~ScopedTimer() {
+    uint64_t elapsed = cycles() - start;
+    ThreadTimers& lt = LocalTimers;
+
+    lt.calls[id]++;
+    lt.exclusive[id] += elapsed - lt.nested;
+
+    if (!--lt.active[id])
+        lt.inclusive[id] += elapsed;
+
+    lt.nested = outerNested + elapsed;
+  }
+
+private:
+  TimerId id;
+  uint64_t start, outerNested;
+};
+
+#define SCOPED_TIMER(id) ScopedTimer scopedTimer(id)
+
+#else
+
+#define SCOPED_TIMER(id)
+
+#endif
+
+
+/// PerfCounts holds hardware and kernel event counts of the search, read with
+/// perf_event_open() by PerfCounters. 'valid' has a bit set for each event that
+/// could be counted, the others are reported as not available.
+
+struct PerfCounts {
+
+  enum Event {
+    TASK_CLOCK, CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, BRANCH_MISSES,
+    DTLB_MISSES, EVENT_NB
+  };
+
+  PerfCounts& operator+=(const PerfCounts& p);
+  PerfCounts operator-(const PerfCounts& p) const;
+  std::string report(uint64_t nodes) const;
+
+  uint64_t count[EVENT_NB];
+  int valid;
+};
+
+
+/// PerfCounters counts the events of the calling thread between start() and
+/// stop() and accumulates them. Counters are opened on the first start() in
+/// the thread to count, and nothing is counted where perf_event_open() is not
+/// available or refused, e.g. outside Linux or with a restrictive setting of
+/// /proc/sys/kernel/perf_event_paranoid. Counts are scaled when the kernel
+/// multiplexes more events than the hardware counters.
+
+class PerfCounters : public PerfCounts {
+
+  int fd[EVENT_NB];
+  uint64_t last[EVENT_NB][3]; // Count, time enabled and time running at start()
+  bool opened;
+
+public:
+  PerfCounters();
+ ~PerfCounters();
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  void start();
+  void stop();
+  void clear() { std::memset(count, 0, sizeof(count)); }
+};
+
+
 /// xorshift64star Pseudo-Random Number Generator
 /// This class is based on original code written and dedicated
 /// to the public domain by Sebastiano Vigna (2014).
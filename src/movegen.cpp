@@ -20,6 +20,7 @@
 
 #include <cassert>
 
+#include "misc.h"
 #include "movegen.h"
 #include "position.h"
 
@@ -68,10 +69,10 @@ namespace {
   template<GenType Type, Square D>
   ExtMove* make_promotions(ExtMove* moveList, Square to, Square ksq) {
 
-    if (Type == CAPTURES || Type == EVASIONS || Type == NON_EVASIONS)
+    if (Type == CAPTURES || Type == EVASIONS || Type == NON_EVASIONS || Type == LEGAL)
         *moveList++ = make<PROMOTION>(to - D, to, QUEEN);
 
-    if (Type == QUIETS || Type == EVASIONS || Type == NON_EVASIONS)
+    if (Type == QUIETS || Type == EVASIONS || Type == NON_EVASIONS || Type == LEGAL)
     {
         *moveList++ = make<PROMOTION>(to - D, to, ROOK);
         *moveList++ = make<PROMOTION>(to - D, to, BISHOP);
@@ -102,12 +103,17 @@ namespace {
     const Square   Right    = (Us == WHITE ? NORTH_EAST : SOUTH_WEST);
     const Square   Left     = (Us == WHITE ? NORTH_WEST : SOUTH_EAST);
 
+    // In legal generation the target is a check mask as for evasions, and
+    // pinned pawns are dealt with separately below.
+    const bool Masked = (Type == EVASIONS || Type == LEGAL);
+
     Bitboard emptySquares;
 
-    Bitboard pawnsOn7    = pos.pieces(Us, PAWN) &  TRank7BB;
-    Bitboard pawnsNotOn7 = pos.pieces(Us, PAWN) & ~TRank7BB;
+    Bitboard pawns       = pos.pieces(Us, PAWN) & ~(Type == LEGAL ? pos.pinned_pieces(Us) : 0);
+    Bitboard pawnsOn7    = pawns &  TRank7BB;
+    Bitboard pawnsNotOn7 = pawns & ~TRank7BB;
 
-    Bitboard enemies = (Type == EVASIONS ? pos.pieces(Them) & target:
+    Bitboard enemies = (Masked           ? pos.pieces(Them) & target:
                         Type == CAPTURES ? target : pos.pieces(Them));
 
     // Single and double pawn pushes, no promotions
@@ -118,7 +124,7 @@ namespace {
         Bitboard b1 = shift<Up>(pawnsNotOn7)   & emptySquares;
         Bitboard b2 = shift<Up>(b1 & TRank3BB) & emptySquares;
 
-        if (Type == EVASIONS) // Consider only blocking squares
+        if (Masked) // Consider only blocking squares
         {
             b1 &= target;
             b2 &= target;
@@ -160,12 +166,12 @@ namespace {
     }
 
     // Promotions and underpromotions
-    if (pawnsOn7 && (Type != EVASIONS || (target & TRank8BB)))
+    if (pawnsOn7 && (!Masked || (target & TRank8BB)))
     {
         if (Type == CAPTURES)
             emptySquares = ~pos.pieces();
 
-        if (Type == EVASIONS)
+        if (Masked)
             emptySquares &= target;
 
         Bitboard b1 = shift<Right>(pawnsOn7) & enemies;
@@ -184,8 +190,44 @@ namespace {
             moveList = make_promotions<Type, Up   >(moveList, pop_lsb(&b3), ksq);
     }
 
+    // Pinned pawns can only push or capture along the line through the king and
+    // the pinner. When in check this line never meets the check mask, so they
+    // have no legal moves at all.
+    if (Type == LEGAL && !pos.checkers())
+    {
+        Square ksq = pos.square<KING>(Us);
+        Bitboard pinned = pos.pieces(Us, PAWN) & pos.pinned_pieces(Us);
+
+        while (pinned)
+        {
+            Square from = pop_lsb(&pinned);
+            Bitboard b = pos.attacks_from<PAWN>(from, Us) & pos.pieces(Them);
+
+            if (pos.empty(from + Up))
+            {
+                b |= from + Up;
+
+                if (rank_of(from) == relative_rank(Us, RANK_2) && pos.empty(from + Up + Up))
+                    b |= from + Up + Up;
+            }
+
+            b &= LineBB[ksq][from];
+
+            while (b)
+            {
+                Square to = pop_lsb(&b);
+
+                if (TRank8BB & to)
+                    for (PieceType pt : { QUEEN, ROOK, BISHOP, KNIGHT })
+                        *moveList++ = make<PROMOTION>(from, to, pt);
+                else
+                    *moveList++ = make_move(from, to);
+            }
+        }
+    }
+
     // Standard and en-passant captures
-    if (Type == CAPTURES || Type == EVASIONS || Type == NON_EVASIONS)
+    if (Type == CAPTURES || Type == EVASIONS || Type == NON_EVASIONS || Type == LEGAL)
     {
         Bitboard b1 = shift<Right>(pawnsNotOn7) & enemies;
         Bitboard b2 = shift<Left >(pawnsNotOn7) & enemies;
@@ -209,15 +251,32 @@ namespace {
             // An en passant capture can be an evasion only if the checking piece
             // is the double pushed pawn and so is in the target. Otherwise this
             // is a discovery check and we are forced to do otherwise.
-            if (Type == EVASIONS && !(target & (pos.ep_square() - Up)))
+            if (Masked && !(target & (pos.ep_square() - Up)))
                 return moveList;
 
-            b1 = pawnsNotOn7 & pos.attacks_from<PAWN>(pos.ep_square(), Them);
+            // Removing two pawns from the same rank can expose the king to a
+            // slider, so in legal generation all en passant captures, pinned
+            // or not, are verified by Position::legal().
+            if (Type == LEGAL)
+            {
+                b1 = pos.pieces(Us, PAWN) & pos.attacks_from<PAWN>(pos.ep_square(), Them);
+
+                while (b1)
+                {
+                    Move m = make<ENPASSANT>(pop_lsb(&b1), pos.ep_square());
+                    if (pos.legal(m))
+                        *moveList++ = m;
+                }
+            }
+            else
+            {
+                b1 = pawnsNotOn7 & pos.attacks_from<PAWN>(pos.ep_square(), Them);
 
-            assert(b1);
+                assert(b1);
 
-            while (b1)
-                *moveList++ = make<ENPASSANT>(pop_lsb(&b1), pos.ep_square());
+                while (b1)
+                    *moveList++ = make<ENPASSANT>(pop_lsb(&b1), pos.ep_square());
+            }
         }
     }
 
@@ -225,13 +284,15 @@ namespace {
   }
 
 
-  template<PieceType Pt, bool Checks>
+  template<PieceType Pt, GenType Type>
   ExtMove* generate_moves(const Position& pos, ExtMove* moveList, Color us,
                           Bitboard target) {
 
     assert(Pt != KING && Pt != PAWN);
 
+    const bool Checks = Type == QUIET_CHECKS;
     const Square* pl = pos.squares<Pt>(us);
+    Bitboard pinned = Type == LEGAL ? pos.pinned_pieces(us) : 0;
 
     for (Square from = *pl; from != SQ_NONE; from = *++pl)
     {
@@ -250,6 +311,11 @@ namespace {
         if (Checks)
             b &= pos.check_squares(Pt);
 
+        // A pinned piece stays on the line through its square and the king.
+        // Knights are never aligned with their destination, so they get none.
+        if (Type == LEGAL && (pinned & from))
+            b &= LineBB[pos.square<KING>(us)][from];
+
         while (b)
             *moveList++ = make_move(from, pop_lsb(&b));
     }
@@ -258,18 +324,49 @@ namespace {
   }
 
 
+  // generate_king_moves() generates the legal king moves, castling excluded. The
+  // destination squares are tested with the king removed from the board, so that
+  // the squares x-rayed by a checking slider through the king are not accepted.
+  ExtMove* generate_king_moves(const Position& pos, ExtMove* moveList, Color us) {
+
+    Square ksq = pos.square<KING>(us);
+    Bitboard occupied = pos.pieces() ^ ksq;
+    Bitboard b = pos.attacks_from<KING>(ksq) & ~pos.pieces(us);
+
+    while (b)
+    {
+        Square to = pop_lsb(&b);
+        if (!(pos.attackers_to(to, occupied) & pos.pieces(~us)))
+            *moveList++ = make_move(ksq, to);
+    }
+
+    return moveList;
+  }
+
+
   template<Color Us, GenType Type>
   ExtMove* generate_all(const Position& pos, ExtMove* moveList, Bitboard target) {
 
     const bool Checks = Type == QUIET_CHECKS;
 
-    moveList = generate_pawn_moves<Us, Type>(pos, moveList, target);
-    moveList = generate_moves<KNIGHT, Checks>(pos, moveList, Us, target);
-    moveList = generate_moves<BISHOP, Checks>(pos, moveList, Us, target);
-    moveList = generate_moves<  ROOK, Checks>(pos, moveList, Us, target);
-    moveList = generate_moves< QUEEN, Checks>(pos, moveList, Us, target);
+    // The two halves of the quiet moves are generated as plain quiets
+    const GenType T = Type == PIECE_QUIETS || Type == PAWN_KING_QUIETS ? QUIETS : Type;
+
+    if (Type != PIECE_QUIETS)
+        moveList = generate_pawn_moves<Us, T>(pos, moveList, target);
+
+    if (Type != PAWN_KING_QUIETS)
+    {
+        moveList = generate_moves<KNIGHT, T>(pos, moveList, Us, target);
+        moveList = generate_moves<BISHOP, T>(pos, moveList, Us, target);
+        moveList = generate_moves<  ROOK, T>(pos, moveList, Us, target);
+        moveList = generate_moves< QUEEN, T>(pos, moveList, Us, target);
+    }
+
+    if (Type == LEGAL && !pos.checkers())
+        moveList = generate_king_moves(pos, moveList, Us);
 
-    if (Type != QUIET_CHECKS && Type != EVASIONS)
+    else if (Type != QUIET_CHECKS && Type != EVASIONS && Type != LEGAL && Type != PIECE_QUIETS)
     {
         Square ksq = pos.square<KING>(Us);
         Bitboard b = pos.attacks_from<KING>(ksq) & target;
@@ -277,7 +374,8 @@ namespace {
             *moveList++ = make_move(ksq, pop_lsb(&b));
     }
 
-    if (Type != CAPTURES && Type != EVASIONS && pos.can_castle(Us))
+    if (   Type != CAPTURES && Type != EVASIONS && Type != PIECE_QUIETS && pos.can_castle(Us)
+        && (Type != LEGAL || !pos.checkers()))
     {
         if (pos.is_chess960())
         {
@@ -305,18 +403,25 @@ namespace {
 ///
 /// generate<NON_EVASIONS> generates all pseudo-legal captures and
 /// non-captures. Returns a pointer to the end of the move list.
+///
+/// generate<PIECE_QUIETS> and generate<PAWN_KING_QUIETS> split the moves of
+/// generate<QUIETS> into those of knights, bishops, rooks and queens, and those
+/// of pawns and the king (castling included), so that they can be generated in
+/// separate stages. Return a pointer to the end of the move list.
 
 template<GenType Type>
 ExtMove* generate(const Position& pos, ExtMove* moveList) {
 
-  assert(Type == CAPTURES || Type == QUIETS || Type == NON_EVASIONS);
+  SCOPED_TIMER(TIMER_GENERATE);
+
+  assert(   Type == CAPTURES || Type == QUIETS || Type == NON_EVASIONS
+         || Type == PIECE_QUIETS || Type == PAWN_KING_QUIETS);
   assert(!pos.checkers());
 
   Color us = pos.side_to_move();
 
   Bitboard target =  Type == CAPTURES     ?  pos.pieces(~us)
-                   : Type == QUIETS       ? ~pos.pieces()
-                   : Type == NON_EVASIONS ? ~pos.pieces(us) : 0;
+                   : Type == NON_EVASIONS ? ~pos.pieces(us) : ~pos.pieces();
 
   return us == WHITE ? generate_all<WHITE, Type>(pos, moveList, target)
                      : generate_all<BLACK, Type>(pos, moveList, target);
@@ -326,6 +431,8 @@ ExtMove* generate(const Position& pos, ExtMove* moveList) {
 template ExtMove* generate<CAPTURES>(const Position&, ExtMove*);
 template ExtMove* generate<QUIETS>(const Position&, ExtMove*);
 template ExtMove* generate<NON_EVASIONS>(const Position&, ExtMove*);
+template ExtMove* generate<PIECE_QUIETS>(const Position&, ExtMove*);
+template ExtMove* generate<PAWN_KING_QUIETS>(const Position&, ExtMove*);
 
 
 /// generate<QUIET_CHECKS> generates all pseudo-legal non-captures and knight
@@ -333,6 +440,8 @@ template ExtMove* generate<NON_EVASIONS>(const Position&, ExtMove*);
 template<>
 ExtMove* generate<QUIET_CHECKS>(const Position& pos, ExtMove* moveList) {
 
+  SCOPED_TIMER(TIMER_GENERATE);
+
   assert(!pos.checkers());
 
   Color us = pos.side_to_move();
@@ -365,6 +474,8 @@ ExtMove* generate<QUIET_CHECKS>(const Position& pos, ExtMove* moveList) {
 template<>
 ExtMove* generate<EVASIONS>(const Position& pos, ExtMove* moveList) {
 
+  SCOPED_TIMER(TIMER_GENERATE);
+
   assert(pos.checkers());
 
   Color us = pos.side_to_move();
@@ -398,23 +509,31 @@ ExtMove* generate<EVASIONS>(const Position& pos, ExtMove* moveList) {
 }
 
 
-/// generate<LEGAL> generates all the legal moves in the given position
+/// generate<LEGAL> generates all the legal moves in the given position. Instead
+/// of filtering pseudo-legal moves through Position::legal(), the pinned pieces
+/// and the check mask are computed once and applied to the whole generation.
 
 template<>
 ExtMove* generate<LEGAL>(const Position& pos, ExtMove* moveList) {
 
-  Bitboard pinned = pos.pinned_pieces(pos.side_to_move());
-  Square ksq = pos.square<KING>(pos.side_to_move());
-  ExtMove* cur = moveList;
+  SCOPED_TIMER(TIMER_GENERATE);
+
+  Color us = pos.side_to_move();
+  Square ksq = pos.square<KING>(us);
+  Bitboard target = ~pos.pieces(us);
+
+  if (pos.checkers())
+  {
+      // King moves first, as in generate<EVASIONS>
+      moveList = generate_king_moves(pos, moveList, us);
+
+      if (more_than_one(pos.checkers()))
+          return moveList; // Double check, only a king move can save the day
 
-  moveList = pos.checkers() ? generate<EVASIONS    >(pos, moveList)
-                            : generate<NON_EVASIONS>(pos, moveList);
-  while (cur != moveList)
-      if (   (pinned || from_sq(*cur) == ksq || type_of(*cur) == ENPASSANT)
-          && !pos.legal(*cur))
-          *cur = (--moveList)->move;
-      else
-          ++cur;
+      // The other pieces must capture the checking piece or block the check
+      target = between_bb(lsb(pos.checkers()), ksq) | pos.checkers();
+  }
 
-  return moveList;
+  return us == WHITE ? generate_all<WHITE, LEGAL>(pos, moveList, target)
+                     : generate_all<BLACK, LEGAL>(pos, moveList, target);
 }
@@ -33,12 +33,15 @@ enum GenType {
   QUIET_CHECKS,
   EVASIONS,
   NON_EVASIONS,
-  LEGAL
+  LEGAL,
+  PIECE_QUIETS,
+  PAWN_KING_QUIETS
 };
 
 struct ExtMove {
   Move move;
   int value;
+  Value see; // Exchange value, cached by MovePicker once computed
 
   operator Move() const { return move; }
   void operator=(Move m) { move = m; }
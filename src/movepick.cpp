@@ -26,7 +26,8 @@
 namespace {
 
   enum Stages {
-    MAIN_SEARCH, CAPTURES_INIT, GOOD_CAPTURES, KILLERS, COUNTERMOVE, QUIET_INIT, QUIET, BAD_CAPTURES,
+    MAIN_SEARCH, CAPTURES_INIT, GOOD_CAPTURES, KILLERS, COUNTERMOVE, QUIET_INIT, GOOD_PIECE_QUIETS,
+    PAWN_KING_QUIET_INIT, QUIET, BAD_CAPTURES,
     EVASION, EVASIONS_INIT, ALL_EVASIONS,
     PROBCUT, PROBCUT_INIT, PROBCUT_CAPTURES,
     QSEARCH_WITH_CHECKS, QCAPTURES_1_INIT, QCAPTURES_1, QCHECKS,
@@ -138,8 +139,11 @@ void MovePicker::score<CAPTURES>() {
   // badCaptures[] array, but instead of doing it now we delay until the move
   // has been picked up, saving some SEE calls in case we get a cutoff.
   for (auto& m : *this)
+  {
       m.value =  PieceValue[MG][pos.piece_on(to_sq(m))]
                - Value(200 * relative_rank(pos.side_to_move(), to_sq(m)));
+      m.see = VALUE_NONE;
+  }
 }
 
 template<>
@@ -154,10 +158,13 @@ void MovePicker::score<QUIETS>() {
   Color c = pos.side_to_move();
 
   for (auto& m : *this)
+  {
       m.value =  cmh[pos.moved_piece(m)][to_sq(m)]
                + fmh[pos.moved_piece(m)][to_sq(m)]
                + fm2[pos.moved_piece(m)][to_sq(m)]
                + history.get(c, m);
+      m.see = VALUE_NONE;
+  }
 }
 
 template<>
@@ -167,11 +174,15 @@ void MovePicker::score<EVASIONS>() {
   Color c = pos.side_to_move();
 
   for (auto& m : *this)
+  {
       if (pos.capture(m))
           m.value =  PieceValue[MG][pos.piece_on(to_sq(m))]
                    - Value(type_of(pos.moved_piece(m))) + HistoryStats::Max;
       else
           m.value = history.get(c, m);
+
+      m.see = VALUE_NONE;
+  }
 }
 
 
@@ -182,8 +193,12 @@ void MovePicker::score<EVASIONS>() {
 
 Move MovePicker::next_move(bool skipQuiets) {
 
+  SCOPED_TIMER(TIMER_NEXT_MOVE);
+
   Move move;
 
+  picked = nullptr;
+
   switch (stage) {
 
   case MAIN_SEARCH: case EVASION: case QSEARCH_WITH_CHECKS:
@@ -204,11 +219,13 @@ Move MovePicker::next_move(bool skipQuiets) {
           move = pick_best(cur++, endMoves);
           if (move != ttMove)
           {
-              if (pos.see_ge(move, VALUE_ZERO))
+              picked = cur - 1;
+              if (see_ge(move, VALUE_ZERO))
                   return move;
 
               // Losing capture, move it to the beginning of the array
-              *endBadCaptures++ = move;
+              *endBadCaptures++ = *picked;
+              picked = nullptr;
           }
       }
 
@@ -245,10 +262,47 @@ Move MovePicker::next_move(bool skipQuiets) {
 
   case QUIET_INIT:
       cur = endBadCaptures;
-      endMoves = generate<QUIETS>(pos, cur);
+      endMoves = generate<PIECE_QUIETS>(pos, cur);
+      score<QUIETS>();
+      partial_insertion_sort(cur, endMoves, -4000 * depth / ONE_PLY);
+      ++stage;
+      /* fallthrough */
+
+  case GOOD_PIECE_QUIETS:
+      // Piece quiets with very good stats are tried before the pawn and king
+      // quiets are generated, which many cut nodes then never need. A single
+      // counter move table saturates at about 32 * 936, so the threshold asks
+      // for the support of more than one statistic.
+      while (    cur < endMoves
+             && (!skipQuiets || cur->value >= VALUE_ZERO)
+             &&  cur->value > 30000)
+      {
+          move = *cur++;
+
+          if (   move != ttMove
+              && move != killers[0]
+              && move != killers[1]
+              && move != countermove)
+          {
+              picked = cur - 1;
+              return move;
+          }
+      }
+      ++stage;
+      /* fallthrough */
+
+  case PAWN_KING_QUIET_INIT:
+  {
+      // Append the pawn and king quiets, score only them and sort them together
+      // with the piece quiets not yet returned.
+      ExtMove* rest = cur;
+      cur = endMoves;
+      endMoves = generate<PAWN_KING_QUIETS>(pos, cur);
       score<QUIETS>();
+      cur = rest;
       partial_insertion_sort(cur, endMoves, -4000 * depth / ONE_PLY);
       ++stage;
+  }
       /* fallthrough */
 
   case QUIET:
@@ -261,7 +315,10 @@ Move MovePicker::next_move(bool skipQuiets) {
               && move != killers[0]
               && move != killers[1]
               && move != countermove)
+          {
+              picked = cur - 1;
               return move;
+          }
       }
       ++stage;
       cur = moves; // Point to beginning of bad captures
@@ -269,7 +326,10 @@ Move MovePicker::next_move(bool skipQuiets) {
 
   case BAD_CAPTURES:
       if (cur < endBadCaptures)
+      {
+          picked = cur;
           return *cur++;
+      }
       break;
 
   case EVASIONS_INIT:
@@ -284,7 +344,10 @@ Move MovePicker::next_move(bool skipQuiets) {
       {
           move = pick_best(cur++, endMoves);
           if (move != ttMove)
+          {
+              picked = cur - 1;
               return move;
+          }
       }
       break;
 
@@ -317,7 +380,10 @@ Move MovePicker::next_move(bool skipQuiets) {
       {
           move = pick_best(cur++, endMoves);
           if (move != ttMove)
+          {
+              picked = cur - 1;
               return move;
+          }
       }
       if (stage == QCAPTURES_2)
           break;
@@ -347,7 +413,10 @@ Move MovePicker::next_move(bool skipQuiets) {
       {
           move = pick_best(cur++, endMoves);
           if (to_sq(move) == recaptureSquare)
+          {
+              picked = cur - 1;
               return move;
+          }
       }
       break;
 
@@ -357,3 +426,21 @@ Move MovePicker::next_move(bool skipQuiets) {
 
   return MOVE_NONE;
 }
+
+
+/// see_ge() tests if the SEE value of a move is greater or equal to the given
+/// value. For the move last returned by next_move() the exchange value is
+/// computed once with Position::see() and cached in its ExtMove, so that the
+/// pruning decisions of the search, which test the same move against several
+/// thresholds, cost a comparison after the first one.
+
+bool MovePicker::see_ge(Move m, Value v) {
+
+  if (!picked || picked->move != m)
+      return pos.see_ge(m, v);
+
+  if (picked->see == VALUE_NONE)
+      picked->see = pos.see(m);
+
+  return picked->see >= v;
+}
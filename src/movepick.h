@@ -30,6 +30,8 @@
 
 /// HistoryStats records how often quiet moves have been successful or unsuccessful
 /// during the current search, and is used for reduction and move ordering decisions.
+/// The update formula keeps entries within [-32 * D, 32 * D], so they are stored
+/// as 16 bit integers to keep the per-thread tables small.
 struct HistoryStats {
 
   static const int Max = 1 << 28;
@@ -43,6 +45,7 @@ struct HistoryStats {
 
     const int D = 324;
 
+    static_assert(32 * D <= INT16_MAX, "History entries must fit in int16_t");
     assert(abs(int(v)) <= D); // Consistency check for below formula
 
     table[c][from][to] -= table[c][from][to] * abs(int(v)) / D;
@@ -50,7 +53,7 @@ struct HistoryStats {
   }
 
 private:
-  int table[COLOR_NB][SQUARE_NB][SQUARE_NB];
+  int16_t table[COLOR_NB][SQUARE_NB][SQUARE_NB];
 };
 
 
@@ -70,6 +73,7 @@ struct Stats {
 
     const int D = 936;
 
+    static_assert(32 * D <= INT16_MAX, "Stats entries must fit in int16_t");
     assert(abs(int(v)) <= D); // Consistency check for below formula
 
     table[pc][to] -= table[pc][to] * abs(int(v)) / D;
@@ -81,7 +85,7 @@ private:
 };
 
 typedef Stats<Move> MoveStats;
-typedef Stats<int> CounterMoveStats;
+typedef Stats<int16_t> CounterMoveStats;
 typedef Stats<CounterMoveStats> CounterMoveHistoryStats;
 
 
@@ -103,6 +107,7 @@ public:
   MovePicker(const Position&, Move, Depth, Search::Stack*);
 
   Move next_move(bool skipQuiets = false);
+  bool see_ge(Move m, Value v);
 
 private:
   template<GenType> void score();
@@ -118,7 +123,7 @@ private:
   Square recaptureSquare;
   Value threshold;
   int stage;
-  ExtMove *cur, *endMoves, *endBadCaptures;
+  ExtMove *cur, *endMoves, *endBadCaptures, *picked;
   ExtMove moves[MAX_MOVES];
 };
 
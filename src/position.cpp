@@ -50,6 +50,18 @@ namespace Zobrist {
 
 namespace {
 
+// Marcel van Kervinck's cuckoo algorithm for fast detection of "upcoming
+// repetition" situations. Description of the algorithm in the following paper:
+// https://marcelk.net/2013-04-06/paper/upcoming-rep-v2.pdf
+
+// First and second hash functions for indexing the cuckoo tables
+inline int H1(Key h) { return h & 0x1fff; }
+inline int H2(Key h) { return (h >> 16) & 0x1fff; }
+
+// Cuckoo tables with Zobrist hashes of valid reversible moves, and the moves themselves
+Key cuckoo[8192];
+Move cuckooMove[8192];
+
 const string PieceToChar(" PNBRQK  pnbrqk");
 
 // min_attacker() is a helper function used by see_ge() to locate the least
@@ -149,6 +161,28 @@ void Position::init() {
 
   Zobrist::side = rng.rand<Key>();
   Zobrist::noPawns = rng.rand<Key>();
+
+  // Prepare the cuckoo tables
+  int count = 0;
+  for (Piece pc : Pieces)
+      for (Square s1 = SQ_A1; s1 <= SQ_H8; ++s1)
+          for (Square s2 = Square(s1 + 1); s2 <= SQ_H8; ++s2)
+              if (PseudoAttacks[type_of(pc)][s1] & s2)
+              {
+                  Move move = make_move(s1, s2);
+                  Key key = Zobrist::psq[pc][s1] ^ Zobrist::psq[pc][s2] ^ Zobrist::side;
+                  int i = H1(key);
+                  while (true)
+                  {
+                      std::swap(cuckoo[i], key);
+                      std::swap(cuckooMove[i], move);
+                      if (move == MOVE_NONE) // Arrived at empty slot?
+                          break;
+                      i = (i == H1(key)) ? H2(key) : H1(key); // Push victim to alternative slot
+                  }
+                  count++;
+              }
+  assert(count == 3668);
 }
 
 
@@ -276,6 +310,7 @@ Position& Position::set(const string& fenStr, bool isChess960, StateInfo* si, Th
   chess960 = isChess960;
   thisThread = th;
   set_state(st);
+  ++repetition_count(st->key);
 
   assert(pos_is_ok());
 
@@ -310,10 +345,14 @@ void Position::set_castling_right(Color c, Square rfrom) {
 }
 
 
-/// Position::set_check_info() sets king attacks to detect if a move gives check
+/// Position::set_check_info() sets king attacks to detect if a move gives check.
+/// After a move it is not called until the data is first needed, because many
+/// nodes are cut off before generating or checking any move (see check_info()).
 
 void Position::set_check_info(StateInfo* si) const {
 
+  si->checkInfoValid = true;
+
   si->blockersForKing[WHITE] = slider_blockers(pieces(BLACK), square<KING>(WHITE), si->pinnersForKing[WHITE]);
   si->blockersForKing[BLACK] = slider_blockers(pieces(WHITE), square<KING>(BLACK), si->pinnersForKing[BLACK]);
 
@@ -383,7 +422,7 @@ void Position::set_state(StateInfo* si) const {
 
 Position& Position::set(const string& code, Color c, StateInfo* si) {
 
-  assert(code.length() > 0 && code.length() < 8);
+  assert(code.length() > 0 && code.length() < 9); // Up to "KPPPPPvK"
   assert(code[0] == 'K');
 
   string sides[] = { code.substr(code.find('K', 1)),      // Weak
@@ -634,7 +673,7 @@ bool Position::gives_check(Move m) const {
   Square to = to_sq(m);
 
   // Is there a direct check?
-  if (st->checkSquares[type_of(piece_on(from))] & to)
+  if (check_squares(type_of(piece_on(from))) & to)
       return true;
 
   // Is there a discovered check?
@@ -685,6 +724,8 @@ bool Position::gives_check(Move m) const {
 
 void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
 
+  SCOPED_TIMER(TIMER_DO_MOVE);
+
   assert(is_ok(m));
   assert(&newSt != st);
 
@@ -841,14 +882,15 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
 
   // Update the key with the final value
   st->key = k;
+  ++repetition_count(k);
 
   // Calculate checkers bitboard (if move gives check)
   st->checkersBB = givesCheck ? attackers_to(square<KING>(them)) & pieces(us) : 0;
 
   sideToMove = ~sideToMove;
 
-  // Update king attacks used for fast check detection
-  set_check_info(st);
+  // King attacks used for fast check detection are computed on first use
+  st->checkInfoValid = false;
 
   assert(pos_is_ok());
 }
@@ -859,6 +901,8 @@ void Position::do_move(Move m, StateInfo& newSt, bool givesCheck) {
 
 void Position::undo_move(Move m) {
 
+  SCOPED_TIMER(TIMER_UNDO_MOVE);
+
   assert(is_ok(m));
 
   sideToMove = ~sideToMove;
@@ -911,6 +955,7 @@ void Position::undo_move(Move m) {
   }
 
   // Finally point our state pointer back to the previous state
+  --repetition_count(st->key);
   st = st->previous;
   --gamePly;
 
@@ -957,13 +1002,14 @@ void Position::do_null_move(StateInfo& newSt) {
 
   st->key ^= Zobrist::side;
   prefetch(TT.first_entry(st->key));
+  ++repetition_count(st->key);
 
   ++st->rule50;
   st->pliesFromNull = 0;
 
   sideToMove = ~sideToMove;
 
-  set_check_info(st);
+  st->checkInfoValid = false;
 
   assert(pos_is_ok());
 }
@@ -972,6 +1018,7 @@ void Position::undo_null_move() {
 
   assert(!checkers());
 
+  --repetition_count(st->key);
   st = st->previous;
   sideToMove = ~sideToMove;
 }
@@ -1002,6 +1049,8 @@ Key Position::key_after(Move m) const {
 
 bool Position::see_ge(Move m, Value v) const {
 
+  SCOPED_TIMER(TIMER_SEE);
+
   assert(is_ok(m));
 
   // Castling moves are implemented as king capturing the rook so cannot be
@@ -1044,6 +1093,7 @@ bool Position::see_ge(Move m, Value v) const {
   // Find all attackers to the destination square, with the moving piece removed,
   // but possibly an X-ray attacker added behind it.
   Bitboard attackers = attackers_to(to, occupied) & occupied;
+  const StateInfo* ci = check_info();
 
   while (true)
   {
@@ -1051,8 +1101,8 @@ bool Position::see_ge(Move m, Value v) const {
 
       // Don't allow pinned pieces to attack pieces except the king as long all
       // pinners are on their original square.
-      if (!(st->pinnersForKing[stm] & ~occupied))
-          stmAttackers &= ~st->blockersForKing[stm];
+      if (!(ci->pinnersForKing[stm] & ~occupied))
+          stmAttackers &= ~ci->blockersForKing[stm];
 
       if (!stmAttackers)
           return relativeStm;
@@ -1076,6 +1126,85 @@ bool Position::see_ge(Move m, Value v) const {
 }
 
 
+/// Position::see() returns the Static Exchange Evaluation of a move, computed
+/// with a swap list under the same rules as see_ge(), so that see(m) >= v is
+/// true exactly when see_ge(m, v) is. It is meant for moves whose SEE is tested
+/// against several thresholds.
+
+Value Position::see(Move m) const {
+
+  SCOPED_TIMER(TIMER_SEE);
+
+  assert(is_ok(m));
+
+  if (type_of(m) == CASTLING)
+      return VALUE_ZERO;
+
+  Square from = from_sq(m), to = to_sq(m);
+  PieceType nextVictim = type_of(piece_on(from));
+  Color stm = ~color_of(piece_on(from)); // First consider opponent's move
+  Value swapList[32];
+  Bitboard occupied, stmAttackers;
+  int d = 0;
+
+  if (type_of(m) == ENPASSANT)
+  {
+      occupied = SquareBB[to - pawn_push(~stm)]; // Remove the captured pawn
+      swapList[0] = PieceValue[MG][PAWN];
+  }
+  else
+  {
+      swapList[0] = PieceValue[MG][piece_on(to)];
+      occupied = 0;
+  }
+
+  if (nextVictim == KING)
+      return swapList[0];
+
+  occupied ^= pieces() ^ from ^ to;
+  Bitboard attackers = attackers_to(to, occupied) & occupied;
+  const StateInfo* ci = check_info();
+
+  while (true)
+  {
+      stmAttackers = attackers & pieces(stm);
+
+      // Don't allow pinned pieces to attack pieces except the king as long all
+      // pinners are on their original square.
+      if (!(ci->pinnersForKing[stm] & ~occupied))
+          stmAttackers &= ~ci->blockersForKing[stm];
+
+      if (!stmAttackers)
+          break;
+
+      // The side to move captures on 'to' with its least valuable attacker. A
+      // king can capture only if the square is no longer defended.
+      PieceType captor = min_attacker<PAWN>(byTypeBB, to, stmAttackers, occupied, attackers);
+
+      if (captor == KING && (attackers & pieces(~stm)))
+          break;
+
+      ++d;
+      swapList[d] = PieceValue[MG][nextVictim] - swapList[d - 1];
+
+      if (captor == KING)
+          break;
+
+      nextVictim = captor;
+      stm = ~stm;
+  }
+
+  // Each side may stop capturing when continuing would lose material
+  while (d)
+  {
+      swapList[d - 1] = -std::max(-swapList[d - 1], swapList[d]);
+      --d;
+  }
+
+  return swapList[0];
+}
+
+
 /// Position::is_draw() tests whether the position is drawn by 50-move rule
 /// or by repetition. It does not detect stalemates.
 
@@ -1086,7 +1215,8 @@ bool Position::is_draw(int ply) const {
 
   int end = std::min(st->rule50, st->pliesFromNull);
 
-  if (end < 4)
+  // No earlier position in the chain shares the bucket of the current key
+  if (end < 4 || repetition_count(st->key) < 2)
     return false;
 
   StateInfo* stp = st->previous->previous;
@@ -1108,6 +1238,79 @@ bool Position::is_draw(int ply) const {
 }
 
 
+/// Position::has_game_cycle() tests if the position has a move which draws by
+/// repetition, or an earlier position has a move that directly reaches the
+/// current position.
+
+bool Position::has_game_cycle(int ply) const {
+
+  int j;
+
+  int end = std::min(st->rule50, st->pliesFromNull);
+
+  if (end < 3)
+    return false;
+
+  Key originalKey = st->key;
+  StateInfo* stp = st->previous;
+
+  for (int i = 3; i <= end; i += 2)
+  {
+      stp = stp->previous->previous;
+
+      Key moveKey = originalKey ^ stp->key;
+      if (   (j = H1(moveKey), cuckoo[j] == moveKey)
+          || (j = H2(moveKey), cuckoo[j] == moveKey))
+      {
+          Move move = cuckooMove[j];
+          Square s1 = from_sq(move);
+          Square s2 = to_sq(move);
+
+          if (!(between_bb(s1, s2) & pieces()))
+          {
+              if (ply > i)
+                  return true;
+
+              // For nodes before or at the root, check that the move is a
+              // repetition rather than a move to the current position. In the
+              // cuckoo table both moves Rc1c5 and Rc5c1 are stored in the same
+              // location, so we have to select which square to check.
+              if (color_of(piece_on(empty(s1) ? s2 : s1)) != side_to_move())
+                  continue;
+
+              // For repetitions before or at the root, require one more
+              StateInfo* next = stp;
+              for (int k = i + 2; k <= end; k += 2)
+              {
+                  next = next->previous->previous;
+                  if (next->key == stp->key)
+                      return true;
+              }
+          }
+      }
+  }
+  return false;
+}
+
+
+/// Position::count_history() adds the keys of the positions that precede the
+/// current one, as far back as a repetition can reach, to the repetition
+/// filter. It is needed when a position is set up from a FEN and then linked
+/// to the game history, as ThreadPool::start_thinking() does.
+
+void Position::count_history() {
+
+  int end = std::min(st->rule50, st->pliesFromNull);
+  StateInfo* stp = st;
+
+  for (int i = 1; i <= end && stp->previous; ++i)
+  {
+      stp = stp->previous;
+      ++repetition_count(stp->key);
+  }
+}
+
+
 /// Position::flip() flips position with the white and black sides reversed. This
 /// is only useful for debugging e.g. for finding evaluation symmetry bugs.
 
@@ -1185,6 +1388,7 @@ bool Position::pos_is_ok(int* failedStep) const {
 
       if (step == State)
       {
+          check_info(); // Compare against the lazily computed fields too
           StateInfo si = *st;
           set_state(&si);
           if (std::memcmp(&si, st, sizeof(StateInfo)))
@@ -54,6 +54,7 @@ struct StateInfo {
   Bitboard   blockersForKing[COLOR_NB];
   Bitboard   pinnersForKing[COLOR_NB];
   Bitboard   checkSquares[PIECE_TYPE_NB];
+  bool       checkInfoValid; // Above three fields are computed on first use
 };
 
 // In a std::deque references to elements are unaffected upon resizing
@@ -137,6 +138,7 @@ public:
 
   // Static Exchange Evaluation
   bool see_ge(Move m, Value value) const;
+  Value see(Move m) const;
 
   // Accessing hash keys
   Key key() const;
@@ -152,7 +154,10 @@ public:
   Thread* this_thread() const;
   uint64_t nodes_searched() const;
   bool is_draw(int ply) const;
+  bool has_game_cycle(int ply) const;
+  void count_history();
   int rule50_count() const;
+  StateInfo* state() const;
   Score psq_score() const;
   Value non_pawn_material(Color c) const;
   Value non_pawn_material() const;
@@ -166,6 +171,7 @@ private:
   void set_castling_right(Color c, Square rfrom);
   void set_state(StateInfo* si) const;
   void set_check_info(StateInfo* si) const;
+  const StateInfo* check_info() const;
 
   // Other helpers
   void put_piece(Piece pc, Square s);
@@ -173,6 +179,10 @@ private:
   void move_piece(Piece pc, Square from, Square to);
   template<bool Do>
   void do_castling(Color us, Square from, Square& to, Square& rfrom, Square& rto);
+  uint16_t& repetition_count(Key k) { return repetitionFilter[k & (RepetitionFilterSize - 1)]; }
+  uint16_t repetition_count(Key k) const { return repetitionFilter[k & (RepetitionFilterSize - 1)]; }
+
+  static const int RepetitionFilterSize = 4096;
 
   // Data members
   Piece board[SQUARE_NB];
@@ -190,6 +200,11 @@ private:
   Thread* thisThread;
   StateInfo* st;
   bool chess960;
+
+  // Number of positions in the state chain, including the current one, whose
+  // key falls in each bucket. A position can only be a repetition if its
+  // bucket counts more than itself.
+  uint16_t repetitionFilter[RepetitionFilterSize];
 };
 
 extern std::ostream& operator<<(std::ostream& os, const Position& pos);
@@ -296,16 +311,22 @@ inline Bitboard Position::checkers() const {
   return st->checkersBB;
 }
 
+inline const StateInfo* Position::check_info() const {
+  if (!st->checkInfoValid)
+      set_check_info(st);
+  return st;
+}
+
 inline Bitboard Position::discovered_check_candidates() const {
-  return st->blockersForKing[~sideToMove] & pieces(sideToMove);
+  return check_info()->blockersForKing[~sideToMove] & pieces(sideToMove);
 }
 
 inline Bitboard Position::pinned_pieces(Color c) const {
-  return st->blockersForKing[c] & pieces(c);
+  return check_info()->blockersForKing[c] & pieces(c);
 }
 
 inline Bitboard Position::check_squares(PieceType pt) const {
-  return st->checkSquares[pt];
+  return check_info()->checkSquares[pt];
 }
 
 inline bool Position::pawn_passed(Color c, Square s) const {
@@ -349,6 +370,10 @@ inline int Position::rule50_count() const {
   return st->rule50;
 }
 
+inline StateInfo* Position::state() const {
+  return st;
+}
+
 inline uint64_t Position::nodes_searched() const {
   return nodes;
 }
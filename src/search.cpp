@@ -143,6 +143,54 @@ namespace {
   EasyMoveManager EasyMove;
   Value DrawValue[COLOR_NB];
 
+  // PerftTable caches the leaf counts of the perft subtrees by position key and
+  // depth. It is shared by all the threads without locking: the key is stored
+  // xor-ed with the data, so that an entry torn by a concurrent write does not
+  // match any position and is simply ignored.
+  struct PerftTable {
+
+    struct Entry {
+      Key key;
+      uint64_t data; // Leaf count in the upper 56 bits, depth in the lower 8
+    };
+
+    // The counts do not depend on the search, so the table is allocated only
+    // when its size changes and the entries are kept from a perft to the next.
+    void resize(size_t mbSize) {
+      size_t count = size_t(1) << msb((mbSize * 1024 * 1024) / sizeof(Entry));
+
+      if (table.size() != count)
+          table.assign(count, Entry());
+    }
+
+    bool probe(Key key, Depth d, uint64_t& cnt) const {
+      const Entry& e = table[key & (table.size() - 1)];
+      uint64_t data = e.data;
+      if ((e.key ^ data) != key || (data & 0xFF) != uint64_t(d / ONE_PLY))
+          return false;
+      cnt = data >> 8;
+      return true;
+    }
+
+    void store(Key key, Depth d, uint64_t cnt) {
+      Entry& e = table[key & (table.size() - 1)];
+      e.data = (cnt << 8) | uint64_t(d / ONE_PLY);
+      e.key = key ^ e.data;
+    }
+
+  private:
+    std::vector<Entry> table;
+  };
+
+  // Perft work shared by the threads: the next root move to be taken and the
+  // leaf count found for each root move. PerftStates holds the root states of
+  // the threads, which must outlive their rootPos, like setupStates does for
+  // a search.
+  PerftTable PerftTT;
+  std::atomic<size_t> PerftNextMove;
+  std::vector<uint64_t> PerftCounts;
+  std::deque<StateInfo> PerftStates;
+
   template <NodeType NT>
   Value search(Position& pos, Stack* ss, Value alpha, Value beta, Depth depth, bool cutNode, bool skipEarlyPruning);
 
@@ -155,6 +203,7 @@ namespace {
   void update_cm_stats(Stack* ss, Piece pc, Square s, int bonus);
   void update_stats(const Position& pos, Stack* ss, Move move, Move* quiets, int quietsCnt, int bonus);
   void check_time();
+  uint64_t split_perft(Position& pos, Depth depth);
 
 } // namespace
 
@@ -191,6 +240,8 @@ void Search::clear() {
 
   TT.clear();
 
+  Tablebases::clear_stats();
+
   for (Thread* th : Threads)
   {
       th->counterMoves.clear();
@@ -198,8 +249,8 @@ void Search::clear() {
       th->counterMoveHistory.clear();
       th->resetCalls = true;
       CounterMoveStats& cm = th->counterMoveHistory[NO_PIECE][0];
-      int* t = &cm[NO_PIECE][0];
-      std::fill(t, t + sizeof(cm), CounterMovePruneThreshold - 1);
+      int16_t* t = &cm[NO_PIECE][0];
+      std::fill(t, t + sizeof(cm) / sizeof(*t), CounterMovePruneThreshold - 1);
   }
 
   Threads.main()->previousScore = VALUE_INFINITE;
@@ -208,27 +259,45 @@ void Search::clear() {
 
 /// Search::perft() is our utility to verify move generation. All the leaf nodes
 /// up to the given depth are generated and counted, and the sum is returned.
+/// At the root the moves are shared out to the threads of the pool. Below the
+/// root the counts of the subtrees are kept in PerftTT, so that transposed
+/// subtrees are walked only once, and the last ply is bulk counted.
 template<bool Root>
 uint64_t Search::perft(Position& pos, Depth depth) {
 
+  // At the root a depth of one ply or less, as in the baseline, lists the
+  // legal moves with a count of one each. Shallower depths cannot go through
+  // split_perft() because Limits.perft == 0 means a normal search.
+  if (Root && depth <= ONE_PLY)
+  {
+      MoveList<LEGAL> moves(pos);
+
+      for (const auto& m : moves)
+          sync_info_out << UCI::move(m, pos.is_chess960()) << ": 1" << sync_info_endl;
+
+      return moves.size();
+  }
+
+  if (Root)
+      return split_perft(pos, depth);
+
+  if (depth <= ONE_PLY)
+      return depth == ONE_PLY ? MoveList<LEGAL>(pos).size() : 1;
+
   StateInfo st;
-  uint64_t cnt, nodes = 0;
-  const bool leaf = (depth == 2 * ONE_PLY);
+  uint64_t nodes = 0;
+
+  if (PerftTT.probe(pos.key(), depth, nodes))
+      return nodes;
 
   for (const auto& m : MoveList<LEGAL>(pos))
   {
-      if (Root && depth <= ONE_PLY)
-          cnt = 1, nodes++;
-      else
-      {
-          pos.do_move(m, st);
-          cnt = leaf ? MoveList<LEGAL>(pos).size() : perft<false>(pos, depth - ONE_PLY);
-          nodes += cnt;
-          pos.undo_move(m);
-      }
-      if (Root)
-          sync_info_out << UCI::move(m, pos.is_chess960()) << ": " << cnt << sync_info_endl;
+      pos.do_move(m, st);
+      nodes += perft<false>(pos, depth - ONE_PLY);
+      pos.undo_move(m);
   }
+
+  PerftTT.store(pos.key(), depth, nodes);
   return nodes;
 }
 
@@ -240,8 +309,15 @@ template uint64_t Search::perft<true>(Position&, Depth);
 
 void MainThread::search() {
 
+  if (Limits.perft)
+  {
+      Thread::search(); // Helpers have been started by split_perft()
+      return;
+  }
+
   Color us = rootPos.side_to_move();
   Time.init(Limits, us, rootPos.game_ply());
+  PerfCounts perfStart = Threads.perf_counts();
 
   int contempt = Options["Contempt"] * PawnValueEg / 100; // From centipawns
   DrawValue[ us] = VALUE_DRAW - Value(contempt);
@@ -288,7 +364,7 @@ void MainThread::search() {
           th->wait_for_search_finished();
 
   // Check if there are threads with a better score than main thread
-  Thread* bestThread = this;
+  bestThread = this;
   if (   !this->easyMovePlayed
       &&  Options["MultiPV"] == 1
       && !Limits.depth
@@ -307,6 +383,14 @@ void MainThread::search() {
 
   previousScore = bestThread->rootMoves[0].score;
 
+  std::string tbReport = TB::block_cache_stats();
+  if (!tbReport.empty())
+      sync_info_out << "info string TB search " << tbReport << sync_info_endl;
+
+  if (Options["PerfCounters"])
+      sync_info_out << "info string " << (Threads.perf_counts() - perfStart).report(Threads.nodes_searched())
+                    << sync_info_endl;
+
   // Send new PV when needed
   if (bestThread != this)
       sync_info_out << UCI::pv(bestThread->rootPos, bestThread->completedDepth, -VALUE_INFINITE, VALUE_INFINITE) << sync_info_endl;
@@ -326,6 +410,29 @@ void MainThread::search() {
 
 void Thread::search() {
 
+  // In perft mode keep taking the next unclaimed root move and count its
+  // subtree, until all of them are done.
+  if (Limits.perft)
+  {
+      StateInfo st;
+      size_t i;
+
+      while ((i = PerftNextMove++) < rootMoves.size())
+      {
+          Move m = rootMoves[i].pv[0];
+          rootPos.do_move(m, st);
+          PerftCounts[i] = perft<false>(rootPos, (Limits.perft - 1) * ONE_PLY);
+          rootPos.undo_move(m);
+      }
+      return;
+  }
+
+  // Count the hardware events of the search of this thread, if requested
+  bool countPerf = Options["PerfCounters"];
+
+  if (countPerf)
+      perf.start();
+
   Stack stack[MAX_PLY+7], *ss = stack+4; // To allow referencing (ss-4) and (ss+2)
   Value bestValue, alpha, beta, delta;
   Move easyMove = MOVE_NONE;
@@ -345,6 +452,7 @@ void Thread::search() {
       EasyMove.clear();
       mainThread->easyMovePlayed = mainThread->failedLow = false;
       mainThread->bestMoveChanges = 0;
+      mainThread->lastBestMove = MOVE_NONE;
       TT.new_search();
   }
 
@@ -462,6 +570,14 @@ void Thread::search() {
       if (!mainThread)
           continue;
 
+      // Remember when the current best move was first found
+      if (rootMoves[0].pv[0] != mainThread->lastBestMove)
+      {
+          mainThread->lastBestMove = rootMoves[0].pv[0];
+          mainThread->lastBestMoveTime = now() - Limits.startTime;
+          mainThread->lastBestMoveNodes = Threads.nodes_searched();
+      }
+
       // If skill level is enabled and time is up, pick a sub-optimal best move
       if (skill.enabled() && skill.time_to_pick(rootDepth))
           skill.pick_best(multiPV);
@@ -510,6 +626,9 @@ void Thread::search() {
       }
   }
 
+  if (countPerf)
+      perf.stop();
+
   if (!mainThread)
       return;
 
@@ -532,6 +651,8 @@ namespace {
   template <NodeType NT>
   Value search(Position& pos, Stack* ss, Value alpha, Value beta, Depth depth, bool cutNode, bool skipEarlyPruning) {
 
+    SCOPED_TIMER(TIMER_SEARCH);
+
     const bool PvNode = NT == PV;
     const bool rootNode = PvNode && (ss-1)->ply == 0;
 
@@ -591,6 +712,16 @@ namespace {
             return ss->ply >= MAX_PLY && !inCheck ? evaluate(pos)
                                                   : DrawValue[pos.side_to_move()];
 
+        // Check if we have an upcoming move which draws by repetition, or if
+        // the opponent had an alternative move earlier to this position.
+        if (   alpha < DrawValue[pos.side_to_move()]
+            && pos.has_game_cycle(ss->ply))
+        {
+            alpha = DrawValue[pos.side_to_move()];
+            if (alpha >= beta)
+                return alpha;
+        }
+
         // Step 3. Mate distance pruning. Even if we mate at the next move our score
         // would be at best mate_in(ss->ply+1), but if alpha is already bigger because
         // a shorter mate was found upward in the tree then there is no need to search
@@ -661,8 +792,20 @@ namespace {
             &&  pos.rule50_count() == 0
             && !pos.can_castle(ANY_CASTLING))
         {
-            TB::ProbeState err;
-            TB::WDLScore v = Tablebases::probe_wdl(pos, &err);
+            TB::ProbeState err = TB::ProbeState::OK;
+            TB::WDLScore v;
+
+            // Endgame searches probe the same positions over and over, so look
+            // in the per-thread cache first to skip the decompression.
+            if (thisThread->wdlCache.probe(pos.key(), &v))
+                thisThread->tbStats.cacheHits++;
+            else
+            {
+                v = Tablebases::probe_wdl(pos, &err, &thisThread->tbProbe);
+
+                if (err != TB::ProbeState::FAIL)
+                    thisThread->wdlCache.store(pos.key(), v);
+            }
 
             if (err != TB::ProbeState::FAIL)
             {
@@ -895,7 +1038,7 @@ moves_loop: // When in check search starts from here
       }
       else if (    givesCheck
                && !moveCountPruning
-               &&  pos.see_ge(move, VALUE_ZERO))
+               &&  mp.see_ge(move, VALUE_ZERO))
           extension = ONE_PLY;
 
       // Calculate new depth for this move
@@ -934,12 +1077,12 @@ moves_loop: // When in check search starts from here
 
               // Prune moves with negative SEE
               if (   lmrDepth < 8
-                  && !pos.see_ge(move, Value(-35 * lmrDepth * lmrDepth)))
+                  && !mp.see_ge(move, Value(-35 * lmrDepth * lmrDepth)))
                   continue;
           }
           else if (    depth < 7 * ONE_PLY
                    && !extension
-                   && !pos.see_ge(move, -PawnValueEg * (depth / ONE_PLY)))
+                   && !mp.see_ge(move, -PawnValueEg * (depth / ONE_PLY)))
                   continue;
       }
 
@@ -960,6 +1103,24 @@ moves_loop: // When in check search starts from here
       // Step 14. Make the move
       pos.do_move(move, st, givesCheck);
 
+      // Start the tablebase probe of the child, so that the table access
+      // overlaps with the work done before its Step 4a, which completes it
+      // from the thread's handle. Only when the child will probe there at
+      // full depth, with the same conditions, and the result is not already
+      // in the WDL cache.
+      if (TB::Cardinality && newDepth >= ONE_PLY)
+      {
+          int piecesCount = pos.count<ALL_PIECES>();
+          TB::WDLScore wdl;
+
+          if (    piecesCount <= TB::Cardinality
+              && (piecesCount <  TB::Cardinality || newDepth >= TB::ProbeDepth)
+              &&  pos.rule50_count() == 0
+              && !pos.can_castle(ANY_CASTLING)
+              && !thisThread->wdlCache.probe(pos.key(), &wdl))
+              TB::prefetch_wdl(pos, &thisThread->tbProbe);
+      }
+
       // Step 15. Reduced depth search (LMR). If the move fails high it will be
       // re-searched at full depth.
       if (    depth >= 3 * ONE_PLY
@@ -1149,6 +1310,8 @@ moves_loop: // When in check search starts from here
   template <NodeType NT, bool InCheck>
   Value qsearch(Position& pos, Stack* ss, Value alpha, Value beta, Depth depth) {
 
+    SCOPED_TIMER(TIMER_QSEARCH);
+
     const bool PvNode = NT == PV;
 
     assert(InCheck == !!pos.checkers());
@@ -1274,7 +1437,7 @@ moves_loop: // When in check search starts from here
               continue;
           }
 
-          if (futilityBase <= alpha && !pos.see_ge(move, VALUE_ZERO + 1))
+          if (futilityBase <= alpha && !mp.see_ge(move, VALUE_ZERO + 1))
           {
               bestValue = std::max(bestValue, futilityBase);
               continue;
@@ -1290,7 +1453,7 @@ moves_loop: // When in check search starts from here
       // Don't search moves with negative SEE values
       if (  (!InCheck || evasionPrunable)
           &&  type_of(move) != PROMOTION
-          &&  !pos.see_ge(move, VALUE_ZERO))
+          &&  !mp.see_ge(move, VALUE_ZERO))
           continue;
 
       // Speculative prefetch as early as possible
@@ -1461,6 +1624,59 @@ moves_loop: // When in check search starts from here
   }
 
 
+  // split_perft() is the root of Search::perft(). It sets up every thread with
+  // the root position and moves, lets the threads share out the root moves
+  // between themselves, and prints the leaf count of each one when all are done.
+
+  uint64_t split_perft(Position& pos, Depth depth) {
+
+    Threads.main()->wait_for_search_finished();
+
+    RootMoves rootMoves;
+    for (const auto& m : MoveList<LEGAL>(pos))
+        rootMoves.push_back(RootMove(m));
+
+    // The threads read Limits.perft to run perft instead of a search, so the
+    // limits of the last search are restored when done.
+    LimitsType limits = Limits;
+
+    Limits = LimitsType();
+    Limits.perft = depth / ONE_PLY;
+    Limits.startTime = now();
+    Signals.stop = false;
+
+    PerftTT.resize(Options["Hash"]);
+    PerftCounts.assign(rootMoves.size(), 0);
+    PerftNextMove = 0;
+    PerftStates.resize(Threads.size());
+
+    for (Thread* th : Threads)
+    {
+        th->rootMoves = rootMoves;
+        th->rootPos.set(pos.fen(), pos.is_chess960(), &PerftStates[th->idx], th);
+    }
+
+    for (Thread* th : Threads)
+        th->start_searching();
+
+    for (Thread* th : Threads)
+        th->wait_for_search_finished();
+
+    uint64_t nodes = 0;
+
+    for (size_t i = 0; i < rootMoves.size(); ++i)
+    {
+        nodes += PerftCounts[i];
+        sync_info_out << UCI::move(rootMoves[i].pv[0], pos.is_chess960())
+                      << ": " << PerftCounts[i] << sync_info_endl;
+    }
+
+    Limits = limits;
+
+    return nodes;
+  }
+
+
   // check_time() is used to print debug info and, more importantly, to detect
   // when we are out of available time and thus stop the search.
 
@@ -1609,6 +1825,10 @@ void Tablebases::filter_root_moves(Position& pos, Search::RootMoves& rootMoves)
             Cardinality = 0;
     }
 
+    std::string tbReport = block_cache_stats();
+    if (!tbReport.empty())
+        sync_info_out << "info string TB root probe " << tbReport << sync_info_endl;
+
     if (RootInTB && !UseRule50)
         TB::Score =  TB::Score > VALUE_DRAW ?  VALUE_MATE - MAX_PLY - 1
                    : TB::Score < VALUE_DRAW ? -VALUE_MATE + MAX_PLY + 1
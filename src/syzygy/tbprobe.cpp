@@ -19,25 +19,34 @@
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <cstring>   // For std::memset
 #include <deque>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <limits>
 #include <list>
+#include <map>
+#include <new>
 #include <sstream>
+#include <thread>
 #include <type_traits>
+#include <unordered_map>
 
 #include "../bitboard.h"
 #include "../movegen.h"
 #include "../position.h"
 #include "../search.h"
+#include "../thread.h"
 #include "../thread_win32.h"
 #include "../types.h"
 
 #include "tbprobe.h"
 
 #ifndef _WIN32
+#include <dirent.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
@@ -50,12 +59,14 @@
 
 using namespace Tablebases;
 
-int Tablebases::MaxCardinality;
+std::atomic<int> Tablebases::MaxCardinality;
+bool Tablebases::CollectStats;
 
 namespace {
 
-// Each table has a set of flags: all of them refer to DTZ tables, the last one to WDL tables
-enum TBFlag { STM = 1, Mapped = 2, WinPlies = 4, LossPlies = 8, SingleValue = 128 };
+// Each table has a set of flags: all of them refer to DTZ tables, the last one to WDL tables.
+// Wide is set by 7-men DTZ tables whose value maps need 16 bit entries.
+enum TBFlag { STM = 1, Mapped = 2, WinPlies = 4, LossPlies = 8, Wide = 16, SingleValue = 128 };
 
 inline WDLScore operator-(WDLScore d) { return WDLScore(-int(d)); }
 inline Square operator^=(Square& s, int i) { return s = Square(int(s) ^ i); }
@@ -102,19 +113,19 @@ struct LR {
 
 static_assert(sizeof(LR) == 3, "LR tree entry must be 3 bytes");
 
-const int TBPIECES = 6;
+const int TBPIECES = 7; // Max number of supported pieces
 
 struct PairsData {
     int flags;
     size_t sizeofBlock;            // Block size in bytes
     size_t span;                   // About every span values there is a SparseIndex[] entry
-    int blocksNum;                 // Number of blocks in the TB file
+    size_t blocksNum;              // Number of blocks in the TB file
     int maxSymLen;                 // Maximum length in bits of the Huffman symbols
     int minSymLen;                 // Minimum length in bits of the Huffman symbols
     Sym* lowestSym;                // lowestSym[l] is the symbol of length l with the lowest value
     LR* btree;                     // btree[sym] stores the left and right symbols that expand sym
     uint16_t* blockLength;         // Number of stored positions (minus one) for each block: 1..65536
-    int blockLengthSize;           // Size of blockLength[] table: padded so it's bigger than blocksNum
+    size_t blockLengthSize;        // Size of blockLength[] table: padded so it's bigger than blocksNum
     SparseEntry* sparseIndex;      // Partial indices into blockLength[]
     size_t sparseIndexSize;        // Size of SparseIndex[] table
     uint8_t* data;                 // Start of Huffman compressed data
@@ -204,6 +215,12 @@ int MapB1H1H7[SQUARE_NB];
 int MapA1D1D4[SQUARE_NB];
 int MapKK[10][SQUARE_NB]; // [MapA1D1D4][SQUARE_NB]
 
+// Nanoseconds elapsed since 'start', used by the probe statistics
+uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+          (std::chrono::steady_clock::now() - start).count();
+}
+
 // Comparison function to sort leading pawns in ascending MapPawns[] order
 bool pawns_comp(Square i, Square j) { return MapPawns[i] < MapPawns[j]; }
 int off_A1H8(Square sq) { return int(rank_of(sq)) - file_of(sq); }
@@ -219,8 +236,8 @@ const Value WDL_to_value[] = {
 const std::string PieceToChar = " PNBRQK  pnbrqk";
 
 int Binomial[6][SQUARE_NB];    // [k][n] k elements from a set of n elements
-int LeadPawnIdx[5][SQUARE_NB]; // [leadPawnsCnt][SQUARE_NB]
-int LeadPawnsSize[5][4];       // [leadPawnsCnt][FILE_A..FILE_D]
+int LeadPawnIdx[6][SQUARE_NB]; // [leadPawnsCnt][SQUARE_NB]
+int LeadPawnsSize[6][4];       // [leadPawnsCnt][FILE_A..FILE_D]
 
 enum { BigEndian, LittleEndian };
 
@@ -255,16 +272,40 @@ class HashTable {
     typedef std::pair<WDLEntry*, DTZEntry*> EntryPair;
     typedef std::pair<Key, EntryPair> Entry;
 
-    static const int TBHASHBITS = 10;
-    static const int HSHMAX     = 5;
+    static const int HSHMAX = 5;
+
+    // Buckets of HSHMAX entries indexed by the upper bits of the key. The table
+    // doubles when a bucket overflows, as happens with 7-men tables.
+    int hashBits;
+    std::vector<Entry> hashTable;
+
+    Entry* bucket(Key key) { return &hashTable[(key >> (64 - hashBits)) * HSHMAX]; }
+
+    void grow() {
+        std::vector<Entry> old;
+        old.swap(hashTable);
+        hashTable.resize(HSHMAX << ++hashBits);
+
+        for (const Entry& e : old)
+            if (e.second.first)
+                insert(e.first, e.second.first, e.second.second);
+    }
 
-    Entry hashTable[1 << TBHASHBITS][HSHMAX];
+    // Entries are never erased from the deques, so that pointers stored in the
+    // hash table stay valid. A slot whose file disappears after a path change is
+    // reset in place and removed from the hash table.
+    struct Slot {
+        std::string file; // Full path of the .rtbw file, empty if not found
+        WDLEntry* wdl;
+        DTZEntry* dtz;
+    };
 
     std::deque<WDLEntry> wdlTable;
     std::deque<DTZEntry> dtzTable;
+    std::map<std::string, Slot> slots; // Indexed by material code, e.g. "KRvK"
 
     void insert(Key key, WDLEntry* wdl, DTZEntry* dtz) {
-        Entry* entry = hashTable[key >> (64 - TBHASHBITS)];
+        Entry* entry = bucket(key);
 
         for (int i = 0; i < HSHMAX; ++i, ++entry)
             if (!entry->second.first || entry->first == key) {
@@ -272,14 +313,24 @@ class HashTable {
                 return;
             }
 
-        std::cerr << "HSHMAX too low!" << std::endl;
-        exit(1);
+        grow();
+        insert(key, wdl, dtz);
+    }
+
+    void remove(Key key) {
+        Entry* entry = bucket(key);
+
+        for (int i = 0; i < HSHMAX; ++i, ++entry)
+            if (entry->first == key)
+                *entry = Entry();
     }
 
 public:
+    HashTable() : hashBits(10), hashTable(HSHMAX << hashBits) {}
+
     template<typename E, int I = std::is_same<E, WDLEntry>::value ? 0 : 1>
     E* get(Key key) {
-      Entry* entry = hashTable[key >> (64 - TBHASHBITS)];
+      Entry* entry = bucket(key);
 
       for (int i = 0; i < HSHMAX; ++i, ++entry)
           if (entry->first == key)
@@ -289,16 +340,39 @@ public:
   }
 
   void clear() {
-      std::memset(hashTable, 0, sizeof(hashTable));
+      std::fill(hashTable.begin(), hashTable.end(), Entry());
+      slots.clear();
       wdlTable.clear();
       dtzTable.clear();
   }
-  size_t size() const { return wdlTable.size(); }
+  size_t size() const {
+      return std::count_if(slots.begin(), slots.end(),
+                           [](const std::pair<const std::string, Slot>& s) { return !s.second.file.empty(); });
+  }
+  int max_cardinality() const {
+      int max = 0;
+      for (const auto& s : slots)
+          if (!s.second.file.empty())
+              max = std::max(s.second.wdl->pieceCount, max);
+      return max;
+  }
   void insert(const std::vector<PieceType>& pieces);
+
+  template<typename F> void for_each(const F& f) {
+      for (auto& s : slots)
+          if (!s.second.file.empty())
+              f(s.first, s.second.wdl, s.second.dtz);
+  }
 };
 
 HashTable EntryTable;
 
+// The thread running a background scan, joined before the next scan or at exit
+struct ScanThread : public std::thread {
+    using std::thread::operator=;
+   ~ScanThread() { if (joinable()) join(); }
+};
+
 class TBFile : public std::ifstream {
 
     std::string fname;
@@ -312,22 +386,91 @@ public:
     // C:\tb\wdl345;C:\tb\wdl6;D:\tb\dtz345;D:\tb\dtz6
     static std::string Paths;
 
-    TBFile(const std::string& f) {
+    // Index of the TB files found in Paths, from file name to full path
+    static std::map<std::string, std::string> Files;
 
 #ifndef _WIN32
-        const char SepChar = ':';
+    static const char SepChar = ':';
 #else
-        const char SepChar = ';';
+    static const char SepChar = ';';
 #endif
+
+    TBFile(const std::string& f) {
+
+        fname = find(f);
+
+        if (!fname.empty())
+            std::ifstream::open(fname);
+    }
+
+    static std::string find(const std::string& f) {
+        auto it = Files.find(f);
+        return it != Files.end() ? it->second : "";
+    }
+
+    // Build the Files index with a single listing of each directory in Paths
+    // instead of one open attempt per candidate file name. Directories are
+    // listed in parallel, and as before the first directory in Paths wins when
+    // a file is found in more than one of them.
+    static void scan() {
+
+        std::vector<std::string> dirs;
         std::stringstream ss(Paths);
         std::string path;
 
-        while (std::getline(ss, path, SepChar)) {
-            fname = path + "/" + f;
-            std::ifstream::open(fname);
-            if (is_open())
-                return;
-        }
+        while (std::getline(ss, path, SepChar))
+            dirs.push_back(path);
+
+        std::vector<std::vector<std::string>> names(dirs.size());
+        std::vector<std::thread> threads;
+
+        for (size_t i = 0; i < dirs.size(); ++i)
+            threads.emplace_back(list, std::cref(dirs[i]), std::ref(names[i]));
+
+        for (std::thread& th : threads)
+            th.join();
+
+        Files.clear();
+
+        for (size_t i = 0; i < dirs.size(); ++i)
+            for (const std::string& n : names[i])
+                Files.insert({n, dirs[i] + "/" + n}); // Keeps the first one found
+    }
+
+    // Append the names of the .rtbw and .rtbz files in the given directory
+    static void list(const std::string& dir, std::vector<std::string>& names) {
+
+        auto isTB = [](const std::string& n) {
+            return    n.size() > 5
+                   && (   !n.compare(n.size() - 5, 5, ".rtbw")
+                       || !n.compare(n.size() - 5, 5, ".rtbz"));
+        };
+
+#ifndef _WIN32
+        DIR* d = opendir(dir.c_str());
+
+        if (!d)
+            return;
+
+        while (dirent* e = readdir(d))
+            if (isTB(e->d_name))
+                names.push_back(e->d_name);
+
+        closedir(d);
+#else
+        WIN32_FIND_DATA fd;
+        HANDLE h = FindFirstFile((dir + "/*").c_str(), &fd);
+
+        if (h == INVALID_HANDLE_VALUE)
+            return;
+
+        do
+            if (isTB(fd.cFileName))
+                names.push_back(fd.cFileName);
+        while (FindNextFile(h, &fd));
+
+        FindClose(h);
+#endif
     }
 
     // Memory map the file and check it. File should be already open and will be
@@ -341,9 +484,20 @@ public:
 #ifndef _WIN32
         struct stat statbuf;
         int fd = ::open(fname.c_str(), O_RDONLY);
-        fstat(fd, &statbuf);
+
+        if (fd == -1 || fstat(fd, &statbuf)) {
+            std::cerr << "Could not open " << fname << std::endl;
+            exit(1);
+        }
+
+        // 7-men files can be larger than the address space of a 32 bit build
+        if (uint64_t(statbuf.st_size) > std::numeric_limits<size_t>::max()) {
+            std::cerr << "File too large to be mapped: " << fname << std::endl;
+            exit(1);
+        }
+
         *mapping = statbuf.st_size;
-        *baseAddress = mmap(nullptr, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        *baseAddress = mmap(nullptr, size_t(statbuf.st_size), PROT_READ, MAP_SHARED, fd, 0);
         ::close(fd);
 
         if (*baseAddress == MAP_FAILED) {
@@ -355,6 +509,12 @@ public:
                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
         DWORD size_high;
         DWORD size_low = GetFileSize(fd, &size_high);
+
+        if (!Is64Bit && size_high) {
+            std::cerr << "File too large to be mapped: " << fname << std::endl;
+            exit(1);
+        }
+
         HANDLE mmap = CreateFileMapping(fd, nullptr, PAGE_READONLY, size_high, size_low, nullptr);
         CloseHandle(fd);
 
@@ -399,6 +559,14 @@ public:
 };
 
 std::string TBFile::Paths;
+std::map<std::string, std::string> TBFile::Files;
+
+ScanThread Scanner;
+ScanThread Preloader;
+std::atomic_bool StopPreload;
+Mutex PreloadMutex; // Held by the Preloader while it advises a table, and to
+                    // join a background scan from another thread
+bool TablesLocked;  // Some tables were mlock()ed by a preload
 
 WDLEntry::WDLEntry(const std::string& code) {
 
@@ -473,6 +641,9 @@ DTZEntry::~DTZEntry() {
         delete pieceTable.precomp;
 }
 
+// Called for every material combination when the paths change. Tables whose
+// file still resolves to the same path keep their mapping and decoding data,
+// moved or vanished ones are reset, and newly found ones are added.
 void HashTable::insert(const std::vector<PieceType>& pieces) {
 
     std::string code;
@@ -480,20 +651,271 @@ void HashTable::insert(const std::vector<PieceType>& pieces) {
     for (PieceType pt : pieces)
         code += PieceToChar[pt];
 
-    TBFile file(code.insert(code.find('K', 1), "v") + ".rtbw"); // KRK -> KRvK
+    code.insert(code.find('K', 1), "v"); // KRK -> KRvK
+
+    std::string fname = TBFile::find(code + ".rtbw");
+
+    auto it = slots.find(code);
 
-    if (!file.is_open())
+    if (it != slots.end() && it->second.file == fname)
+    {
+        // A DTZ file that was not found before could be in one of the new paths
+        DTZEntry* dtz = it->second.dtz;
+        if (dtz->ready && !dtz->baseAddress)
+        {
+            dtz->~DTZEntry();
+            new (dtz) DTZEntry(*it->second.wdl);
+        }
         return;
+    }
+
+    if (it == slots.end())
+    {
+        if (fname.empty())
+            return;
+
+        wdlTable.push_back(WDLEntry(code));
+        dtzTable.push_back(DTZEntry(wdlTable.back()));
+        it = slots.insert({code, Slot{fname, &wdlTable.back(), &dtzTable.back()}}).first;
+    }
+    else
+    {
+        // The file moved or disappeared: release the stale mapping in place
+        Slot& slot = it->second;
+        slot.wdl->~WDLEntry();
+        slot.dtz->~DTZEntry();
+        new (slot.wdl) WDLEntry(code);
+        new (slot.dtz) DTZEntry(*slot.wdl);
+        slot.file = fname;
+    }
+
+    WDLEntry* wdl = it->second.wdl;
+    DTZEntry* dtz = it->second.dtz;
+
+    if (fname.empty())
+    {
+        remove(wdl->key);
+        remove(wdl->key2);
+    }
+    else
+    {
+        insert(wdl->key , wdl, dtz);
+        insert(wdl->key2, wdl, dtz);
+    }
+}
+
+// The Huffman symbols of a decoded block, with the cumulated number of values
+// they represent: syms[i] expands into the values in [ends[i - 1], ends[i]).
+struct DecodedBlock {
+    std::vector<Sym> syms;
+    std::vector<uint32_t> ends;
+
+    size_t bytes() const { return sizeof(*this) + 64 + syms.size() * (sizeof(Sym) + sizeof(uint32_t)); }
+    Sym find(int& offset) const;
+};
+
+typedef std::pair<const PairsData*, size_t> BlockId;
+
+struct BlockIdHash {
+    size_t operator()(const BlockId& id) const {
+        return std::hash<const void*>()(id.first) ^ size_t(id.second * 0x9E3779B97F4A7C15ULL);
+    }
+};
+
+// BlockCache is an LRU cache of decoded blocks shared by all the threads, so
+// that probes of neighbouring positions, that usually fall in the same block,
+// do not read the block again. It is split in shards, each one with its own
+// lock, to limit contention. The size is given in MB, zero disables it.
+class BlockCache {
+
+    static const int ShardsNb = 16;
+
+    struct Shard {
+        Mutex mutex;
+        std::list<std::pair<BlockId, DecodedBlock>> lru; // Most recently used first
+        std::unordered_map<BlockId, decltype(lru)::iterator, BlockIdHash> index;
+        size_t bytes = 0;
+    };
+
+    Shard shards[ShardsNb];
+    size_t capacity = 0;
+    std::atomic<uint64_t> hits, misses, hitNs, missNs;
+
+public:
+    bool enabled() const { return capacity > 0; }
+    Sym find(PairsData* d, size_t block, int& offset);
+    void resize(size_t mbSize);
+    void clear();
+    std::string stats();
+};
+
+BlockCache DecodedBlocks;
+
+// Read the Huffman symbols of a block from its start until the one that
+// contains the value at 'offset', that is then made relative to that symbol.
+// If 'decoded' is given, the symbols and the cumulated number of values they
+// represent are stored there and the whole block is read.
+Sym read_symbol(PairsData* d, size_t block, int& offset, DecodedBlock* decoded = nullptr) {
+
+    // Find the start address of our block of canonical Huffman symbols
+    uint32_t* ptr = (uint32_t*)(d->data + block * d->sizeofBlock);
+
+    // Read the first 64 bits in our block, this is a (truncated) sequence of
+    // unknown number of symbols of unknown length but we know the first one
+    // is at the beginning of this 64 bits sequence.
+    uint64_t buf64 = number<uint64_t, BigEndian>(ptr); ptr += 2;
+    int buf64Size = 64;
+    uint32_t total = 0;
+    Sym sym;
+
+    while (true) {
+        int len = 0; // This is the symbol length - d->min_sym_len
+
+        // Now get the symbol length. For any symbol s64 of length l right-padded
+        // to 64 bits we know that d->base64[l-1] >= s64 >= d->base64[l] so we
+        // can find the symbol length iterating through base64[].
+        while (buf64 < d->base64[len])
+            ++len;
+
+        // All the symbols of a given length are consecutive integers (numerical
+        // sequence property), so we can compute the offset of our symbol of
+        // length len, stored at the beginning of buf64.
+        sym = (buf64 - d->base64[len]) >> (64 - len - d->minSymLen);
+
+        // Now add the value of the lowest symbol of length len to get our symbol
+        sym += number<Sym, LittleEndian>(&d->lowestSym[len]);
+
+        if (decoded) {
+            decoded->syms.push_back(sym);
+            decoded->ends.push_back(total += d->symlen[sym] + 1);
+
+            if (total > d->blockLength[block])
+                return sym;
+        }
+
+        // If our offset is within the number of values represented by symbol sym
+        // we are done...
+        else if (offset < d->symlen[sym] + 1)
+            return sym;
+
+        // ...otherwise update the offset and continue to iterate
+        else
+            offset -= d->symlen[sym] + 1;
+
+        len += d->minSymLen; // Get the real length
+        buf64 <<= len;       // Consume the just processed symbol
+        buf64Size -= len;
+
+        if (buf64Size <= 32) { // Refill the buffer
+            buf64Size += 32;
+            buf64 |= (uint64_t)number<uint32_t, BigEndian>(ptr++) << (64 - buf64Size);
+        }
+    }
+}
+
+// Find the symbol through the decoded block: a binary search on the cumulated
+// number of values, instead of reading the block up to the offset.
+Sym DecodedBlock::find(int& offset) const {
+
+    size_t i = std::upper_bound(ends.begin(), ends.end(), uint32_t(offset)) - ends.begin();
+
+    assert(i < syms.size());
+
+    offset -= i ? ends[i - 1] : 0;
+    return syms[i];
+}
+
+// Return the symbol of the block containing the value at 'offset' through the
+// cache, decoding and inserting the block on a miss. The block is decoded
+// outside the lock, so that threads missing in the same shard do not wait.
+Sym BlockCache::find(PairsData* d, size_t block, int& offset) {
+
+    bool timed = CollectStats;
+    auto start = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    BlockId id(d, block);
+    Shard& shard = shards[BlockIdHash()(id) % ShardsNb];
+    Sym sym;
+    bool hit;
+
+    {
+        std::unique_lock<Mutex> lk(shard.mutex);
+        auto it = shard.index.find(id);
+
+        if ((hit = (it != shard.index.end())))
+        {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            sym = it->second->second.find(offset);
+        }
+    }
+
+    if (!hit)
+    {
+        DecodedBlock decoded;
+        int dummy = 0;
+        read_symbol(d, block, dummy, &decoded);
+        sym = decoded.find(offset);
+
+        size_t bytes = decoded.bytes();
+        std::unique_lock<Mutex> lk(shard.mutex);
+
+        if (!shard.index.count(id))
+        {
+            shard.lru.emplace_front(id, std::move(decoded));
+            shard.index[id] = shard.lru.begin();
+            shard.bytes += bytes;
+
+            while (shard.bytes > capacity / ShardsNb && shard.lru.size() > 1)
+            {
+                shard.bytes -= shard.lru.back().second.bytes();
+                shard.index.erase(shard.lru.back().first);
+                shard.lru.pop_back();
+            }
+        }
+    }
 
-    file.close();
+    (hit ? hits : misses).fetch_add(1, std::memory_order_relaxed);
 
-    MaxCardinality = std::max((int)pieces.size(), MaxCardinality);
+    if (timed)
+        (hit ? hitNs : missNs).fetch_add(elapsed_ns(start), std::memory_order_relaxed);
+
+    return sym;
+}
 
-    wdlTable.push_back(WDLEntry(code));
-    dtzTable.push_back(DTZEntry(wdlTable.back()));
+void BlockCache::resize(size_t mbSize) {
 
-    insert(wdlTable.back().key , &wdlTable.back(), &dtzTable.back());
-    insert(wdlTable.back().key2, &wdlTable.back(), &dtzTable.back());
+    clear();
+    capacity = mbSize * 1024 * 1024;
+}
+
+void BlockCache::clear() {
+
+    for (Shard& shard : shards)
+    {
+        std::unique_lock<Mutex> lk(shard.mutex);
+        shard.lru.clear();
+        shard.index.clear();
+        shard.bytes = 0;
+    }
+}
+
+// Return a summary of the cache activity since the last call, or an empty
+// string if the cache was not used.
+std::string BlockCache::stats() {
+
+    uint64_t h = hits.exchange(0), m = misses.exchange(0);
+    uint64_t hNs = hitNs.exchange(0), mNs = missNs.exchange(0);
+    std::stringstream ss;
+
+    if (!h && !m)
+        return "";
+
+    ss << "block cache hits " << h << " misses " << m
+       << " hitrate " << (h + m ? 100 * h / (h + m) : 0) << "%";
+
+    if (hNs || mNs)
+        ss << " avg ns hit " << (h ? hNs / h : 0) << " miss " << (m ? mNs / m : 0);
+
+    return ss.str();
 }
 
 // TB tables are compressed with canonical Huffman code. The compressed data is divided into
@@ -556,49 +978,10 @@ int decompress_pairs(PairsData* d, uint64_t idx) {
     while (offset > d->blockLength[block])
         offset -= d->blockLength[block++] + 1;
 
-    // Finally, we find the start address of our block of canonical Huffman symbols
-    uint32_t* ptr = (uint32_t*)(d->data + block * d->sizeofBlock);
-
-    // Read the first 64 bits in our block, this is a (truncated) sequence of
-    // unknown number of symbols of unknown length but we know the first one
-    // is at the beginning of this 64 bits sequence.
-    uint64_t buf64 = number<uint64_t, BigEndian>(ptr); ptr += 2;
-    int buf64Size = 64;
-    Sym sym;
-
-    while (true) {
-        int len = 0; // This is the symbol length - d->min_sym_len
-
-        // Now get the symbol length. For any symbol s64 of length l right-padded
-        // to 64 bits we know that d->base64[l-1] >= s64 >= d->base64[l] so we
-        // can find the symbol length iterating through base64[].
-        while (buf64 < d->base64[len])
-            ++len;
-
-        // All the symbols of a given length are consecutive integers (numerical
-        // sequence property), so we can compute the offset of our symbol of
-        // length len, stored at the beginning of buf64.
-        sym = (buf64 - d->base64[len]) >> (64 - len - d->minSymLen);
-
-        // Now add the value of the lowest symbol of length len to get our symbol
-        sym += number<Sym, LittleEndian>(&d->lowestSym[len]);
-
-        // If our offset is within the number of values represented by symbol sym
-        // we are done...
-        if (offset < d->symlen[sym] + 1)
-            break;
-
-        // ...otherwise update the offset and continue to iterate
-        offset -= d->symlen[sym] + 1;
-        len += d->minSymLen; // Get the real length
-        buf64 <<= len;       // Consume the just processed symbol
-        buf64Size -= len;
-
-        if (buf64Size <= 32) { // Refill the buffer
-            buf64Size += 32;
-            buf64 |= (uint64_t)number<uint32_t, BigEndian>(ptr++) << (64 - buf64Size);
-        }
-    }
+    // Finally, find the symbol that contains the value at 'offset' and make the
+    // offset relative to it, from the cache of decoded blocks when enabled.
+    Sym sym = DecodedBlocks.enabled() ? DecodedBlocks.find(d, block, offset)
+                                      : read_symbol(d, block, offset);
 
     // Ok, now we have our symbol that expands into d->symlen[sym] + 1 symbols.
     // We binary-search for our value recursively expanding into the left and
@@ -652,8 +1035,12 @@ int map_score(DTZEntry* entry, File f, int value, WDLScore wdl) {
 
     uint16_t* idx = entry->hasPawns ? entry->pawnTable.file[f].map_idx
                                     : entry->pieceTable.map_idx;
-    if (flags & TBFlag::Mapped)
-        value = map[idx[WDLMap[wdl + 2]] + value];
+    if (flags & TBFlag::Mapped) {
+        if (flags & TBFlag::Wide)
+            value = ((uint16_t*)map)[idx[WDLMap[wdl + 2]] + value];
+        else
+            value = map[idx[WDLMap[wdl + 2]] + value];
+    }
 
     // DTZ tables store distance to zero in number of moves or plies. We
     // want to return plies, so we have convert to plies when needed.
@@ -672,18 +1059,20 @@ int map_score(DTZEntry* entry, File f, int value, WDLScore wdl) {
 //
 //      idx = Binomial[1][s1] + Binomial[2][s2] + ... + Binomial[k][sk]
 //
-template<typename Entry, typename T = typename Ret<Entry>::type>
-T do_probe_table(const Position& pos,  Entry* entry, WDLScore wdl, ProbeState* result) {
+// Return the table storing the position and set 'idx' to the position index
+// in it. Return nullptr if it is a DTZ table that stores only the other side
+// to move.
+template<typename Entry>
+PairsData* encode(const Position& pos, Entry* entry, uint64_t& idx, File& tbFile) {
 
     const bool IsWDL = std::is_same<Entry, WDLEntry>::value;
 
     Square squares[TBPIECES];
     Piece pieces[TBPIECES];
-    uint64_t idx;
     int next = 0, size = 0, leadPawnsCnt = 0;
     PairsData* d;
     Bitboard b, leadPawns = 0;
-    File tbFile = FILE_A;
+    tbFile = FILE_A;
 
     // A given TB entry like KRK has associated two material keys: KRvk and Kvkr.
     // If both sides have the same pieces keys are equal. In this case TB tables
@@ -732,7 +1121,7 @@ T do_probe_table(const Position& pos,  Entry* entry, WDLScore wdl, ProbeState* r
     // move or only for black to move, so check for side to move to be stm,
     // early exit otherwise.
     if (!IsWDL && !check_dtz_stm(entry, stm, tbFile))
-        return *result = CHANGE_STM, T();
+        return nullptr;
 
     // Now we are ready to get all the position pieces (but the lead pawns) and
     // directly map them to the correct color and square.
@@ -883,10 +1272,62 @@ encode_remaining:
         groupSq += d->groupLen[next];
     }
 
+    return d;
+}
+
+template<typename Entry, typename T = typename Ret<Entry>::type>
+T do_probe_table(const Position& pos, Entry* entry, WDLScore wdl, ProbeState* result,
+                 const ProbeHandle* h) {
+
+    uint64_t idx;
+    File tbFile;
+    PairsData* d;
+
+    // Second phase of a probe started by prefetch_table(), the encoding is done
+    if (h && h->key == pos.key())
+    {
+        d = (PairsData*)h->table;
+        idx = h->idx;
+        tbFile = File(h->file);
+    }
+    else
+        d = encode(pos, entry, idx, tbFile);
+
+    if (!d)
+        return *result = CHANGE_STM, T();
+
     // Now that we have the index, decompress the pair and get the score
     return map_score(entry, tbFile, decompress_pairs(d, idx), wdl);
 }
 
+// First phase of a two-phase probe: compute the WDL table storing the position
+// and its index there, and prefetch the sparse index entry that locates the
+// block. The handle lets a later probe_table() skip the encoding and complete
+// the decode, hopefully with the entry already in cache. Tables not yet mapped
+// are skipped and leave the handle empty.
+void prefetch_table(const Position& pos, ProbeHandle* h) {
+
+    h->key = 0;
+
+    if (!(pos.pieces() ^ pos.pieces(KING)))
+        return;
+
+    WDLEntry* entry = EntryTable.get<WDLEntry>(pos.material_key());
+
+    if (!entry || !entry->ready.load(std::memory_order_acquire) || !entry->baseAddress)
+        return;
+
+    File tbFile;
+    PairsData* d = encode(pos, entry, h->idx, tbFile);
+
+    if (!(d->flags & TBFlag::SingleValue))
+        prefetch(&d->sparseIndex[h->idx / d->span]);
+
+    h->key = pos.key();
+    h->table = d;
+    h->file = tbFile;
+}
+
 // Group together pieces that will be encoded together. The general rule is that
 // a group contains pieces of same type and color. The exception is the leading
 // group that, in case of positions withouth pawns, can be formed by 3 different
@@ -986,7 +1427,7 @@ uint8_t* set_sizes(PairsData* d, uint8_t* data) {
 
     // groupLen[] is a zero-terminated list of group lengths, the last groupIdx[]
     // element stores the biggest index that is the tb size.
-    uint64_t tbSize = d->groupIdx[std::find(d->groupLen, d->groupLen + 7, 0) - d->groupLen];
+    uint64_t tbSize = d->groupIdx[std::find(d->groupLen, d->groupLen + TBPIECES + 1, 0) - d->groupLen];
 
     d->sizeofBlock = 1ULL << *data++;
     d->span = 1ULL << *data++;
@@ -1047,7 +1488,19 @@ uint8_t* set_dtz_map(DTZEntry&, T& p, uint8_t* data, File maxFile) {
     p.map = data;
 
     for (File f = FILE_A; f <= maxFile; ++f) {
-        if (item(p, 0, f).precomp->flags & TBFlag::Mapped)
+        int flags = item(p, 0, f).precomp->flags;
+
+        if (!(flags & TBFlag::Mapped))
+            continue;
+
+        if (flags & TBFlag::Wide) {
+            data += (uintptr_t)data & 1; // Word alignment, a table may mix both kinds
+            for (int i = 0; i < 4; ++i) { // Sequence of 16 bit counts and values
+                item(p, 0, f).map_idx[i] = (uint16_t)((uint16_t*)data - (uint16_t*)p.map + 1);
+                data += 2 * number<uint16_t, LittleEndian>(data) + 2;
+            }
+        }
+        else
             for (int i = 0; i < 4; ++i) { // Sequence like 3,x,x,x,1,x,0,2,x,x
                 item(p, 0, f).map_idx[i] = (uint16_t)(data - p.map + 1);
                 data += *data + 1;
@@ -1129,18 +1582,31 @@ void* init(Entry& e, const Position& pos) {
 
     const bool IsWDL = std::is_same<Entry, WDLEntry>::value;
 
-    static Mutex mutex;
+    // Each entry is initialized under its own lock, selected by material key
+    // and table type, so that different tables are mapped concurrently. The
+    // lock is not embedded in the entry because entries are copied and reset
+    // in place when the paths change.
+    static Mutex mutexes[256];
 
     // Avoid a thread reads 'ready' == true while another is still in do_init(),
     // this could happen due to compiler reordering.
     if (e.ready.load(std::memory_order_acquire))
         return e.baseAddress;
 
-    std::unique_lock<Mutex> lk(mutex);
+    bool timed = CollectStats;
+    auto start = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    std::unique_lock<Mutex> lk(mutexes[(e.key ^ IsWDL) & 255]);
+    Thread* th = pos.this_thread();
+
+    if (th && timed)
+        th->tbStats.initWaitNs += elapsed_ns(start);
 
     if (e.ready.load(std::memory_order_relaxed)) // Recheck under lock
         return e.baseAddress;
 
+    if (th)
+        th->tbStats.inits++;
+
     // Pieces strings in decreasing order for each color, like ("KPP","KR")
     std::string fname, w, b;
     for (PieceType pt = KING; pt >= PAWN; --pt) {
@@ -1163,17 +1629,26 @@ void* init(Entry& e, const Position& pos) {
 }
 
 template<typename E, typename T = typename Ret<E>::type>
-T probe_table(const Position& pos, ProbeState* result, WDLScore wdl = WDLDraw) {
+T probe_table(const Position& pos, ProbeState* result, WDLScore wdl = WDLDraw,
+              const ProbeHandle* h = nullptr) {
 
     if (!(pos.pieces() ^ pos.pieces(KING)))
         return T(WDLDraw); // KvK
 
+    bool timed = CollectStats;
+    auto start = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
     E* entry = EntryTable.get<E>(pos.material_key());
 
     if (!entry || !init(*entry, pos))
         return *result = FAIL, T();
 
-    return do_probe_table(pos, entry, wdl, result);
+    T v = do_probe_table(pos, entry, wdl, result, h);
+    Thread* th = pos.this_thread();
+
+    if (th && timed)
+        th->tbStats.add(std::is_same<E, DTZEntry>::value, elapsed_ns(start));
+
+    return v;
 }
 
 // For a position where the side to move has a winning capture it is not necessary
@@ -1190,15 +1665,24 @@ T probe_table(const Position& pos, ProbeState* result, WDLScore wdl = WDLDraw) {
 // where the best move is an ep-move (even if losing). So in all these cases set
 // the state to ZEROING_BEST_MOVE.
 template<bool CheckZeroingMoves = false>
-WDLScore search(Position& pos, ProbeState* result) {
+WDLScore search(Position& pos, ProbeState* result, const ProbeHandle* h = nullptr) {
 
     WDLScore value, bestValue = WDLLoss;
     StateInfo st;
+    ProbeHandle own;
 
     auto moveList = MoveList<LEGAL>(pos);
     size_t totalCount = moveList.size(), moveCount = 0;
 
-    for (const Move& move : moveList)
+    // Start the probe of the position, unless the caller already did, so that
+    // the table access overlaps with the search of the captures below.
+    if (!h || h->key != pos.key())
+    {
+        prefetch_table(pos, &own);
+        h = &own;
+    }
+
+    for (const ExtMove& move : moveList)
     {
         if (   !pos.capture(move)
             && (!CheckZeroingMoves || type_of(pos.moved_piece(move)) != PAWN))
@@ -1237,7 +1721,7 @@ WDLScore search(Position& pos, ProbeState* result) {
         value = bestValue;
     else
     {
-        value = probe_table<WDLEntry>(pos, result);
+        value = probe_table<WDLEntry>(pos, result, WDLDraw, h);
 
         if (*result == FAIL)
             return WDLDraw;
@@ -1251,16 +1735,9 @@ WDLScore search(Position& pos, ProbeState* result) {
     return *result = OK, value;
 }
 
-} // namespace
-
-void Tablebases::init(const std::string& paths) {
-
-    EntryTable.clear();
-    MaxCardinality = 0;
-    TBFile::Paths = paths;
-
-    if (paths.empty() || paths == "<empty>")
-        return;
+// Init the lookup tables used to encode a position into a table index. They do
+// not depend on the TB files, so they are computed only once.
+void init_encoding() {
 
     // MapB1H1H7[] encodes a square below a1-h8 diagonal to 0..27
     int code = 0;
@@ -1324,9 +1801,9 @@ void Tablebases::init(const std::string& paths) {
     // among pawns with same file, the one with lowest rank.
     int availableSquares = 47; // Available squares when lead pawn is in a2
 
-    // Init the tables for the encoding of leading pawns group: with 6-men TB we
-    // can have up to 4 leading pawns (KPPPPK).
-    for (int leadPawnsCnt = 1; leadPawnsCnt <= 4; ++leadPawnsCnt)
+    // Init the tables for the encoding of leading pawns group: with 7-men TB we
+    // can have up to 5 leading pawns (KPPPPPK).
+    for (int leadPawnsCnt = 1; leadPawnsCnt <= 5; ++leadPawnsCnt)
         for (File f = FILE_A; f <= FILE_D; ++f)
         {
             // Restart the index at every file because TB table is splitted
@@ -1355,6 +1832,13 @@ void Tablebases::init(const std::string& paths) {
             // After a file is traversed, store the cumulated per-file index
             LeadPawnsSize[leadPawnsCnt][f] = idx;
         }
+}
+
+// Scan the directories in TBFile::Paths and update the entry table for all
+// the material combinations. MaxCardinality is published only at the end.
+void update_entries() {
+
+    TBFile::scan();
 
     for (PieceType p1 = PAWN; p1 < KING; ++p1) {
         EntryTable.insert({KING, p1, KING});
@@ -1369,11 +1853,22 @@ void Tablebases::init(const std::string& paths) {
             for (PieceType p3 = PAWN; p3 <= p2; ++p3) {
                 EntryTable.insert({KING, p1, p2, p3, KING});
 
-                for (PieceType p4 = PAWN; p4 <= p3; ++p4)
+                for (PieceType p4 = PAWN; p4 <= p3; ++p4) {
                     EntryTable.insert({KING, p1, p2, p3, p4, KING});
 
-                for (PieceType p4 = PAWN; p4 < KING; ++p4)
+                    for (PieceType p5 = PAWN; p5 <= p4; ++p5)
+                        EntryTable.insert({KING, p1, p2, p3, p4, p5, KING});
+
+                    for (PieceType p5 = PAWN; p5 < KING; ++p5)
+                        EntryTable.insert({KING, p1, p2, p3, p4, KING, p5});
+                }
+
+                for (PieceType p4 = PAWN; p4 < KING; ++p4) {
                     EntryTable.insert({KING, p1, p2, p3, KING, p4});
+
+                    for (PieceType p5 = PAWN; p5 <= p4; ++p5)
+                        EntryTable.insert({KING, p1, p2, p3, KING, p4, p5});
+                }
             }
 
             for (PieceType p3 = PAWN; p3 <= p1; ++p3)
@@ -1382,9 +1877,281 @@ void Tablebases::init(const std::string& paths) {
         }
     }
 
+    MaxCardinality = EntryTable.max_cardinality();
+
     sync_info_out << "info string Found " << EntryTable.size() << " tablebases" << sync_info_endl;
 }
 
+// Ask the OS to read ahead the whole mapped file and, if 'lock' is set, pin it
+// in RAM, so that it is not evicted under memory pressure, e.g. from the TT.
+void advise(TBEntry& e, bool lock) {
+
+#ifndef _WIN32
+    madvise(e.baseAddress, e.mapping, MADV_WILLNEED);
+
+    if (lock ? mlock(e.baseAddress, e.mapping) : munlock(e.baseAddress, e.mapping))
+        std::cerr << "Could not " << (lock ? "mlock()" : "munlock()") << " a TB file" << std::endl;
+#else
+    (void)e, (void)lock; // Not supported
+#endif
+}
+
+// Map and init the WDL tables with up to 'maxPieces' pieces, then warm them
+// up, so that the first probes of a game do not pay the page faults. Runs in
+// the Preloader thread, after a pending background scan is completed.
+void preload_entries(int maxPieces, bool lock) {
+
+    {
+        std::unique_lock<Mutex> lk(PreloadMutex); // Also joined by residency()
+
+        if (Scanner.joinable())
+            Scanner.join();
+    }
+
+    EntryTable.for_each([&](const std::string& code, WDLEntry* wdl, DTZEntry*) {
+
+        if (StopPreload || wdl->pieceCount > maxPieces)
+            return;
+
+        StateInfo st;
+        Position pos;
+
+        if (init(*wdl, pos.set(code, WHITE, &st)))
+        {
+            std::unique_lock<Mutex> lk(PreloadMutex);
+            advise(*wdl, lock);
+        }
+    });
+}
+
+// Release the pages of all the mapped tables pinned by an earlier preload
+void unlock_entries() {
+
+#ifndef _WIN32
+    auto unlock = [](TBEntry& e) {
+        if (e.ready.load(std::memory_order_acquire) && e.baseAddress)
+            munlock(e.baseAddress, e.mapping);
+    };
+
+    EntryTable.for_each([&](const std::string&, WDLEntry* wdl, DTZEntry* dtz) {
+        unlock(*wdl);
+        unlock(*dtz);
+    });
+#endif
+}
+
+} // namespace
+
+// Init the TB entries for the given paths. The call is a no-op when the paths
+// did not change, so that mapped files and decoding data are kept across games.
+// Otherwise the entries are updated incrementally, see HashTable::insert(). If
+// 'background' is set the scan runs in its own thread and the tables are not
+// probed until it completes, so that the GUI is not kept waiting.
+void Tablebases::init(const std::string& paths, bool background) {
+
+    static bool encodingReady = false;
+
+    if (paths == TBFile::Paths)
+        return;
+
+    StopPreload = true;
+
+    if (Preloader.joinable())
+        Preloader.join();
+
+    if (Scanner.joinable())
+        Scanner.join();
+
+    DecodedBlocks.clear(); // Keyed by PairsData pointers that may be freed below
+
+    TBFile::Paths = paths;
+    MaxCardinality = 0; // Do not probe while the entries are updated
+
+    if (paths.empty() || paths == "<empty>")
+    {
+        TBFile::Files.clear();
+        EntryTable.clear();
+        return;
+    }
+
+    if (!encodingReady)
+    {
+        init_encoding();
+        encodingReady = true;
+    }
+
+    if (background)
+        Scanner = std::thread(update_entries);
+    else
+        update_entries();
+}
+
+// Resize the cache to the largest power of 2 number of entries that fits in
+// mbSize megabytes. A zero size disables the cache.
+void WDLCache::resize(size_t mbSize) {
+
+    size_t count = mbSize * 1024 * 1024 / sizeof(uint64_t);
+
+    while (count & (count - 1))
+        count &= count - 1;
+
+    table.assign(count, 0);
+    mask = count ? count - 1 : 0;
+}
+
+// Warm up the WDL tables with up to 'maxPieces' pieces in a background thread,
+// see preload_entries(). Zero disables the warm up. When 'lock' is cleared the
+// tables pinned by a previous preload are released, whatever 'maxPieces' is.
+void Tablebases::preload(int maxPieces, bool lock) {
+
+    StopPreload = true;
+
+    if (Preloader.joinable())
+        Preloader.join();
+
+    StopPreload = false;
+
+    if (!lock && TablesLocked)
+    {
+        unlock_entries();
+        TablesLocked = false;
+    }
+
+    TablesLocked |= lock && maxPieces > 0;
+
+    if (maxPieces > 0)
+        Preloader = std::thread(preload_entries, maxPieces, lock);
+}
+
+// Return, for each mapped table, its size and how much of it is resident in RAM
+std::string Tablebases::residency() {
+
+    std::stringstream ss;
+
+#ifndef _WIN32
+    size_t pageSize = sysconf(_SC_PAGESIZE), total = 0, resident = 0;
+
+    auto report = [&](const std::string& name, const TBEntry& e) {
+
+        // Entries are mapped by the search threads and by the Preloader, the
+        // mapping is complete once 'ready' is set.
+        if (!e.ready.load(std::memory_order_acquire) || !e.baseAddress)
+            return;
+
+        std::vector<unsigned char> pages((e.mapping + pageSize - 1) / pageSize);
+        mincore(e.baseAddress, e.mapping, pages.data());
+
+        size_t cnt = std::count_if(pages.begin(), pages.end(), [](unsigned char c) { return c & 1; });
+
+        ss << name << " " << e.mapping / 1024 << " KB resident "
+           << 100 * cnt / pages.size() << "%\n";
+
+        total += e.mapping;
+        resident += std::min(cnt * pageSize, size_t(e.mapping));
+    };
+
+    // Do not walk the tables while the Preloader is advising one, nor while
+    // a background scan is still updating them.
+    std::unique_lock<Mutex> lk(PreloadMutex);
+
+    if (Scanner.joinable())
+        Scanner.join();
+
+    EntryTable.for_each([&](const std::string& code, WDLEntry* wdl, DTZEntry* dtz) {
+        report(code + ".rtbw", *wdl);
+        report(code + ".rtbz", *dtz);
+    });
+
+    ss << "Total mapped " << total / 1024 << " KB resident " << resident / 1024 << " KB";
+#else
+    ss << "Residency report not supported on Windows";
+#endif
+
+    return ss.str();
+}
+
+void Tablebases::clear_stats() {
+
+    for (Thread* th : Threads)
+        th->tbStats.clear();
+}
+
+// Return the probe statistics summed over all the threads: for WDL and DTZ the
+// number of probes, mean latency, upper bounds of the median and 99th
+// percentile and the non-empty buckets of the latency histogram.
+std::string Tablebases::stats() {
+
+    ProbeStats sum;
+    sum.clear();
+
+    for (Thread* th : Threads)
+    {
+        const ProbeStats& s = th->tbStats;
+
+        for (int t = 0; t < 2; ++t)
+            for (int i = 0; i < ProbeStats::Buckets; ++i)
+                sum.latency[t][i] += s.latency[t][i];
+
+        sum.cacheHits += s.cacheHits;
+        sum.inits += s.inits;
+        sum.initWaitNs += s.initWaitNs;
+    }
+
+    std::stringstream ss;
+
+    if (!CollectStats)
+        ss << "Probe latency not timed, set SyzygyStats to enable it\n";
+
+    for (int t = 0; CollectStats && t < 2; ++t)
+    {
+        uint64_t* h = sum.latency[t];
+        uint64_t cnt = 0, ns = 0;
+
+        for (int i = 0; i < ProbeStats::Buckets; ++i)
+            cnt += h[i], ns += h[i] * (3ULL << i) / 2; // Bucket midpoint
+
+        // Upper bound of the bucket where the given fraction of probes is reached
+        auto percentile = [&](double f) {
+            uint64_t acc = 0;
+            for (int i = 0; i < ProbeStats::Buckets; ++i)
+                if ((acc += h[i]) >= f * cnt)
+                    return 2ULL << i;
+            return 0ULL;
+        };
+
+        ss << (t ? "DTZ" : "WDL") << " probes " << cnt;
+
+        if (cnt)
+            ss << " mean " << ns / cnt << " ns p50 < " << percentile(0.5)
+               << " ns p99 < " << percentile(0.99) << " ns";
+
+        ss << "\n";
+
+        for (int i = 0; i < ProbeStats::Buckets; ++i)
+            if (h[i])
+                ss << "  < " << std::setw(10) << (2ULL << i) << " ns "
+                   << std::setw(10) << h[i] << "\n";
+    }
+
+    ss << "WDL cache hits " << sum.cacheHits
+       << "\nFirst touch inits " << sum.inits;
+
+    if (CollectStats)
+        ss << " init lock wait " << sum.initWaitNs / 1000 << " us";
+
+    return ss.str();
+}
+
+void Tablebases::resize_block_cache(size_t mbSize) { DecodedBlocks.resize(mbSize); }
+std::string Tablebases::block_cache_stats() { return DecodedBlocks.stats(); }
+
+// Start a probe of the WDL table for a particular position, to be completed by
+// a later call to probe_wdl() with the same handle. See prefetch_table().
+void Tablebases::prefetch_wdl(const Position& pos, ProbeHandle* h) {
+
+    prefetch_table(pos, h);
+}
+
 // Probe the WDL table for a particular position.
 // If *result != FAIL, the probe was successful.
 // The return value is from the point of view of the side to move:
@@ -1393,10 +2160,12 @@ void Tablebases::init(const std::string& paths) {
 //  0 : draw
 //  1 : win, but draw under 50-move rule
 //  2 : win
-WDLScore Tablebases::probe_wdl(Position& pos, ProbeState* result) {
+WDLScore Tablebases::probe_wdl(Position& pos, ProbeState* result, const ProbeHandle* h) {
+
+    SCOPED_TIMER(TIMER_TB_PROBE);
 
     *result = OK;
-    return search(pos, result);
+    return search(pos, result, h);
 }
 
 // Probe the DTZ table for a particular position.
@@ -1426,6 +2195,8 @@ WDLScore Tablebases::probe_wdl(Position& pos, ProbeState* result) {
 // then do not accept moves leading to dtz + 50-move-counter == 100.
 int Tablebases::probe_dtz(Position& pos, ProbeState* result) {
 
+    SCOPED_TIMER(TIMER_TB_PROBE);
+
     *result = OK;
     WDLScore wdl = search<true>(pos, result);
 
@@ -1484,6 +2255,47 @@ int Tablebases::probe_dtz(Position& pos, ProbeState* result) {
     return minDTZ == 0xFFFF ? -1 : minDTZ;
 }
 
+// Set the score of each root move to the result of 'probe' on the position
+// after the move. With cold caches each probe may fault in pages from disk, so
+// the moves are spread across the search threads, idle at this point, each one
+// working on its own copy of the root position. Return false if a probe failed.
+template<typename F>
+bool probe_root_moves(Position& pos, Search::RootMoves& rootMoves, const F& probe) {
+
+    std::atomic<size_t> next(0);
+    std::atomic_bool failed(false);
+    const std::string fen = pos.fen();
+
+    auto job = [&](Thread* th) {
+
+        StateInfo rootSt, st;
+        Position p;
+        p.set(fen, pos.is_chess960(), &rootSt, th);
+
+        for (size_t i = next++; i < rootMoves.size() && !failed; i = next++)
+        {
+            ProbeState result = OK;
+            Move move = rootMoves[i].pv[0];
+
+            p.do_move(move, st);
+            int v = probe(p, &result);
+            p.undo_move(move);
+
+            if (result == FAIL)
+                failed = true;
+            else
+                rootMoves[i].score = Value(v);
+        }
+    };
+
+    if (Threads.size() > 1 && rootMoves.size() > 1)
+        Threads.execute(job);
+    else
+        job(pos.this_thread());
+
+    return !failed;
+}
+
 // Check whether there has been at least one repetition of positions
 // since the last capture or pawn move.
 static int has_repeated(StateInfo *st)
@@ -1523,46 +2335,39 @@ bool Tablebases::root_probe(Position& pos, Search::RootMoves& rootMoves, Value&
     if (result == FAIL)
         return false;
 
-    StateInfo st;
-
     // Probe each move
-    for (size_t i = 0; i < rootMoves.size(); ++i) {
-        Move move = rootMoves[i].pv[0];
-        pos.do_move(move, st);
+    auto probe = [dtz](Position& p, ProbeState* res) {
         int v = 0;
 
-        if (pos.checkers() && dtz > 0) {
+        if (p.checkers() && dtz > 0) {
             ExtMove s[MAX_MOVES];
 
-            if (generate<LEGAL>(pos, s) == s)
+            if (generate<LEGAL>(p, s) == s)
                 v = 1;
         }
 
         if (!v) {
-            if (st.rule50 != 0) {
-                v = -probe_dtz(pos, &result);
+            if (p.rule50_count() != 0) {
+                v = -probe_dtz(p, res);
 
                 if (v > 0)
                     ++v;
                 else if (v < 0)
                     --v;
             } else {
-                v = -probe_wdl(pos, &result);
+                v = -probe_wdl(p, res);
                 v = dtz_before_zeroing(WDLScore(v));
             }
         }
 
-        pos.undo_move(move);
-
-        if (result == FAIL)
-            return false;
+        return v;
+    };
 
-        rootMoves[i].score = (Value)v;
-    }
+    if (!probe_root_moves(pos, rootMoves, probe))
+        return false;
 
-    // Obtain 50-move counter for the root position.
-    // In Stockfish there seems to be no clean way, so we do it like this:
-    int cnt50 = st.previous->rule50;
+    // Obtain 50-move counter for the root position
+    int cnt50 = pos.rule50_count();
 
     // Use 50-move counter to determine whether the root position is
     // won, lost or drawn.
@@ -1601,7 +2406,7 @@ bool Tablebases::root_probe(Position& pos, Search::RootMoves& rootMoves, Value&
 
         // If the current phase has not seen repetitions, then try all moves
         // that stay safely within the 50-move budget, if there are any.
-        if (!has_repeated(st.previous) && best + cnt50 <= 99)
+        if (!has_repeated(pos.state()) && best + cnt50 <= 99)
             max = 99 - cnt50;
 
         for (size_t i = 0; i < rootMoves.size(); ++i) {
@@ -1657,25 +2462,16 @@ bool Tablebases::root_probe_wdl(Position& pos, Search::RootMoves& rootMoves, Val
 
     score = WDL_to_value[wdl + 2];
 
-    StateInfo st;
-
-    int best = WDLLoss;
-
     // Probe each move
-    for (size_t i = 0; i < rootMoves.size(); ++i) {
-        Move move = rootMoves[i].pv[0];
-        pos.do_move(move, st);
-        WDLScore v = -Tablebases::probe_wdl(pos, &result);
-        pos.undo_move(move);
+    auto probe = [](Position& p, ProbeState* res) { return int(-Tablebases::probe_wdl(p, res)); };
 
-        if (result == FAIL)
-            return false;
+    if (!probe_root_moves(pos, rootMoves, probe))
+        return false;
 
-        rootMoves[i].score = (Value)v;
+    int best = WDLLoss;
 
-        if (v > best)
-            best = v;
-    }
+    for (size_t i = 0; i < rootMoves.size(); ++i)
+        best = std::max(int(rootMoves[i].score), best);
 
     size_t j = 0;
 
@@ -20,8 +20,13 @@
 #ifndef TBPROBE_H
 #define TBPROBE_H
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <ostream>
+#include <vector>
 
+#include "../bitboard.h"
 #include "../search.h"
 
 namespace Tablebases {
@@ -44,10 +49,79 @@ enum ProbeState {
     ZEROING_BEST_MOVE =  2  // Best move zeroes DTZ (capture or pawn move)
 };
 
-extern int MaxCardinality;
+extern std::atomic<int> MaxCardinality;
+extern bool CollectStats; // Time the probes, set by the SyzygyStats option
 
-void init(const std::string& paths);
-WDLScore probe_wdl(Position& pos, ProbeState* result);
+/// ProbeStats records, for a thread, the WDL cache hits, the tables initialized
+/// on first touch and, only when CollectStats is set because reading the clock
+/// on every probe is not free, the latency of the table probes in log2 buckets
+/// of nanoseconds, split by WDL and DTZ, and the time spent waiting for the
+/// init lock.
+struct ProbeStats {
+
+  static const int Buckets = 32;
+
+  uint64_t latency[2][Buckets]; // [WDL / DTZ][log2 of ns]
+  uint64_t cacheHits, inits, initWaitNs;
+
+  void clear() { std::memset(this, 0, sizeof(ProbeStats)); }
+  void add(bool isDTZ, uint64_t ns) {
+    latency[isDTZ][std::min(ns ? msb(ns) : 0, Buckets - 1)]++;
+  }
+};
+
+/// WDLCache stores the results of WDL probes indexed by position key, so that
+/// repeated probes of the same position skip the table decompression. Each
+/// thread has its own cache, so no locking is needed. An entry packs the key,
+/// except its 3 lowest bits that are implied by the index, with the score + 3
+/// in a single 64 bit word. A zero entry is empty.
+class WDLCache {
+
+  std::vector<uint64_t> table;
+  Key mask = 0;
+
+public:
+  void resize(size_t mbSize);
+  void clear() { std::fill(table.begin(), table.end(), 0); }
+
+  bool probe(Key key, WDLScore* v) const {
+    if (table.empty())
+        return false;
+
+    uint64_t e = table[key & mask];
+    if (!(e & 7) || (e ^ key) >> 3)
+        return false;
+
+    *v = WDLScore(int(e & 7) - 3);
+    return true;
+  }
+
+  void store(Key key, WDLScore v) {
+    if (!table.empty())
+        table[key & mask] = (key & ~Key(7)) | uint64_t(v + 3);
+  }
+};
+
+/// ProbeHandle is what the first phase of a two-phase WDL probe, prefetch_wdl(),
+/// hands over to the second one, probe_wdl(): the table storing the position
+/// and the index of the position in it, so that the probe does not encode the
+/// position again. A handle computed for another position is ignored.
+struct ProbeHandle {
+  Key key;           // Key of the position, zero when there is no probe started
+  const void* table; // PairsData of the table, opaque outside tbprobe.cpp
+  uint64_t idx;
+  int file;
+};
+
+void init(const std::string& paths, bool background = false);
+void preload(int maxPieces, bool lock);
+std::string residency();
+void clear_stats();
+std::string stats();
+void resize_block_cache(size_t mbSize);
+std::string block_cache_stats();
+void prefetch_wdl(const Position& pos, ProbeHandle* h);
+WDLScore probe_wdl(Position& pos, ProbeState* result, const ProbeHandle* h = nullptr);
 int probe_dtz(Position& pos, ProbeState* result);
 bool root_probe(Position& pos, Search::RootMoves& rootMoves, Value& score);
 bool root_probe_wdl(Position& pos, Search::RootMoves& rootMoves, Value& score);
@@ -37,7 +37,10 @@ Thread::Thread() {
   resetCalls = exit = false;
   maxPly = callsCnt = 0;
   tbHits = 0;
+  tbStats.clear();
+  tbProbe.key = 0;
   idx = Threads.size(); // Start from 0
+  wdlCache.resize(Options["SyzygyCache"]);
 
   std::unique_lock<Mutex> lk(mutex);
   searching = true;
@@ -90,6 +93,20 @@ void Thread::start_searching(bool resume) {
 }
 
 
+/// Thread::execute() waits for the thread to be idle, then wakes it up to run
+/// 'f' instead of a search. Completion is waited for with wait_for_search_finished().
+
+void Thread::execute(std::function<void()> f) {
+
+  std::unique_lock<Mutex> lk(mutex);
+  sleepCondition.wait(lk, [&]{ return !searching; });
+
+  job = std::move(f);
+  searching = true;
+  sleepCondition.notify_one();
+}
+
+
 /// Thread::idle_loop() is where the thread is parked when it has no work to do
 
 void Thread::idle_loop() {
@@ -110,7 +127,15 @@ void Thread::idle_loop() {
 
       lk.unlock();
 
-      if (!exit)
+      if (exit)
+          break;
+
+      if (job)
+      {
+          job();
+          job = nullptr;
+      }
+      else
           search();
   }
 }
@@ -157,6 +182,20 @@ void ThreadPool::read_uci_options() {
 }
 
 
+/// ThreadPool::execute() runs 'f' on all the threads and waits for them to
+/// finish. It is used to spread work done before the search,
+/// like root tablebase probing.
+
+void ThreadPool::execute(const std::function<void(Thread*)>& f) {
+
+  for (Thread* th : *this)
+      th->execute([&f, th]{ f(th); });
+
+  for (Thread* th : *this)
+      th->wait_for_search_finished();
+}
+
+
 /// ThreadPool::nodes_searched() returns the number of nodes searched
 
 uint64_t ThreadPool::nodes_searched() const {
@@ -179,6 +218,17 @@ uint64_t ThreadPool::tb_hits() const {
 }
 
 
+/// ThreadPool::perf_counts() returns the performance counts of all the threads
+
+PerfCounts ThreadPool::perf_counts() const {
+
+  PerfCounts counts = PerfCounts();
+  for (Thread* th : *this)
+      counts += th->perf;
+  return counts;
+}
+
+
 /// ThreadPool::start_thinking() wakes up the main thread sleeping in idle_loop()
 /// and starts a new search, then returns immediately.
 
@@ -212,6 +262,7 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
   {
       th->maxPly = 0;
       th->tbHits = 0;
+      th->tbProbe.key = 0; // Tables may have been reloaded since the last search
       th->rootDepth = DEPTH_ZERO;
       th->rootMoves = rootMoves;
       th->rootPos.set(pos.fen(), pos.is_chess960(), &setupStates->back(), th);
@@ -219,5 +270,8 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
 
   setupStates->back() = tmp; // Restore st->previous, cleared by Position::set()
 
+  for (Thread* th : Threads)
+      th->rootPos.count_history();
+
   main()->start_searching();
 }
@@ -24,6 +24,7 @@
 #include <atomic>
 #include <bitset>
 #include <condition_variable>
+#include <functional>
 #include <mutex>
 #include <thread>
 #include <vector>
@@ -33,6 +34,7 @@
 #include "pawns.h"
 #include "position.h"
 #include "search.h"
+#include "syzygy/tbprobe.h"
 #include "thread_win32.h"
 
 
@@ -47,6 +49,7 @@ class Thread {
   Mutex mutex;
   ConditionVariable sleepCondition;
   bool exit, searching;
+  std::function<void()> job;
 
 public:
   Thread();
@@ -54,11 +57,16 @@ public:
   virtual void search();
   void idle_loop();
   void start_searching(bool resume = false);
+  void execute(std::function<void()> f);
   void wait_for_search_finished();
   void wait(std::atomic_bool& condition);
 
   Pawns::Table pawnsTable;
   Material::Table materialTable;
+  Tablebases::WDLCache wdlCache;
+  Tablebases::ProbeStats tbStats;
+  Tablebases::ProbeHandle tbProbe; // Started by the parent of the current node
+  PerfCounters perf;
   Endgames endgames;
   size_t idx, PVIdx;
   int maxPly, callsCnt;
@@ -80,6 +88,10 @@ public:
 struct MainThread : public Thread {
   virtual void search();
 
+  Thread* bestThread; // Thread whose move was played in the last search
+  Move lastBestMove;  // Best move after the last iteration, with the time and
+  TimePoint lastBestMoveTime; // nodes when it first became best, for epdbench
+  uint64_t lastBestMoveNodes;
   bool easyMovePlayed, failedLow;
   double bestMoveChanges;
   Value previousScore;
@@ -97,9 +109,11 @@ struct ThreadPool : public std::vector<Thread*> {
 
   MainThread* main() { return static_cast<MainThread*>(at(0)); }
   void start_thinking(Position&, StateListPtr&, const Search::LimitsType&);
+  void execute(const std::function<void(Thread*)>& f);
   void read_uci_options();
   uint64_t nodes_searched() const;
   uint64_t tb_hits() const;
+  PerfCounts perf_counts() const;
 
 private:
   StateListPtr setupStates;
@@ -37,6 +37,12 @@
 ///
 /// -DUSE_PEXT    | Add runtime support for use of pext asm-instruction. Works
 ///               | only in 64-bit mode and requires hardware with pext support.
+///
+/// -DUSE_AVX2    | Compute the attacks of several sliders at once with AVX2
+///               | vector instructions. Requires hardware with AVX2 support.
+///
+/// -DUSE_AVX512  | As -DUSE_AVX2 but with AVX-512 vectors, eight sliders at a
+///               | time. Requires hardware with AVX-512F support.
 
 #include <cassert>
 #include <cctype>
@@ -79,6 +85,14 @@
 #  define pext(b, m) (0)
 #endif
 
+#if defined(USE_AVX512) && !defined(USE_AVX2)
+#  define USE_AVX2
+#endif
+
+#if defined(USE_AVX2) && !defined(USE_PEXT)
+#  include <immintrin.h> // Header for AVX2 and AVX-512 intrinsics
+#endif
+
 #ifdef USE_POPCNT
 const bool HasPopCnt = true;
 #else
@@ -91,6 +105,12 @@ const bool HasPext = true;
 const bool HasPext = false;
 #endif
 
+#ifdef USE_AVX2
+const bool HasAvx2 = true;
+#else
+const bool HasAvx2 = false;
+#endif
+
 #ifdef IS_64BIT
 const bool Is64Bit = true;
 #else
@@ -35,6 +35,8 @@
 using namespace std;
 
 extern void benchmark(const Position& pos, istream& is);
+extern void scalebench(const Position& pos, istream& is);
+extern void epdbench(const Position& pos, istream& is);
 
 namespace {
 
@@ -216,8 +218,12 @@ void UCI::loop(int argc, char* argv[]) {
       // Additional custom non-UCI commands, useful for debugging
       else if (token == "flip")       pos.flip();
       else if (token == "bench")      benchmark(pos, is);
+      else if (token == "scalebench") scalebench(pos, is);
+      else if (token == "epdbench")   epdbench(pos, is);
       else if (token == "d")          sync_info_out << pos << sync_info_endl;
       else if (token == "eval")       sync_info_out << Eval::trace(pos) << sync_info_endl;
+      else if (token == "tbresidency") sync_info_out << Tablebases::residency() << sync_info_endl;
+      else if (token == "tbstats")    sync_info_out << Tablebases::stats() << sync_info_endl;
       else if (token == "perft")
       {
           int depth;
@@ -40,7 +40,14 @@ void on_clear_hash(const Option&) { Search::clear(); }
 void on_hash_size(const Option& o) { TT.resize(o); }
 void on_logger(const Option& o) { start_logger(o); }
 void on_threads(const Option&) { Threads.read_uci_options(); }
-void on_tb_path(const Option& o) { Tablebases::init(o); }
+void on_tb_cache(const Option& o) { for (Thread* th : Threads) th->wdlCache.resize(o); }
+void on_tb_block_cache(const Option& o) { Tablebases::resize_block_cache(o); }
+void on_tb_stats(const Option& o) { Tablebases::CollectStats = o; }
+void on_tb_preload(const Option&) { Tablebases::preload(Options["SyzygyPreload"], Options["SyzygyLock"]); }
+void on_tb_path(const Option& o) {
+  Tablebases::init(o, Options["SyzygyBackgroundScan"]);
+  Tablebases::preload(Options["SyzygyPreload"], Options["SyzygyLock"]);
+}
 
 
 /// Our case insensitive less() function as required by UCI protocol
@@ -73,7 +80,14 @@ void init(OptionsMap& o) {
   o["SyzygyPath"]            << Option("/localdisk/jkottas/syzygy", on_tb_path);
   o["SyzygyProbeDepth"]      << Option(1, 1, 100);
   o["Syzygy50MoveRule"]      << Option(true);
-  o["SyzygyProbeLimit"]      << Option(6, 0, 6);
+  o["SyzygyProbeLimit"]      << Option(7, 0, 7);
+  o["SyzygyBackgroundScan"]  << Option(false);
+  o["SyzygyCache"]           << Option(1, 0, 1024, on_tb_cache);
+  o["SyzygyBlockCache"]      << Option(0, 0, 4096, on_tb_block_cache);
+  o["SyzygyPreload"]         << Option(0, 0, 7, on_tb_preload);
+  o["SyzygyLock"]            << Option(false, on_tb_preload);
+  o["SyzygyStats"]           << Option(false, on_tb_stats);
+  o["PerfCounters"]          << Option(false);
 }
 
 